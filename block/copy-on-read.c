@@ -23,16 +23,45 @@
 #include "qemu/osdep.h"
 #include "block/block_int.h"
 #include "qemu/module.h"
+#include "qemu/option.h"
 #include "qapi/error.h"
 #include "qapi/qmp/qdict.h"
 #include "block/copy-on-read.h"
+#include "trace.h"
 
 
 typedef struct BDRVStateCOR {
     BlockDriverState *bottom_bs;
     bool chain_frozen;
+
+    /* Sequential read-ahead, disabled if 0 */
+    uint64_t readahead;
+    int64_t seq_end;        /* end of the last guest read */
+    int64_t readahead_end;  /* end of the area prefetched so far */
+    bool readahead_in_flight;
 } BDRVStateCOR;
 
+typedef struct CORReadahead {
+    BlockDriverState *bs;
+    int64_t offset;
+    int64_t bytes;
+} CORReadahead;
+
+#define COR_OPT_READAHEAD "readahead"
+static QemuOptsList runtime_opts = {
+    .name = "copy-on-read",
+    .head = QTAILQ_HEAD_INITIALIZER(runtime_opts.head),
+    .desc = {
+        {
+            .name = COR_OPT_READAHEAD,
+            .type = QEMU_OPT_SIZE,
+            .help = "number of bytes to prefetch ahead of sequential reads, "
+                "default 0 (disabled)",
+        },
+        { /* end of list */ }
+    },
+};
+
 
 static int cor_open(BlockDriverState *bs, QDict *options, int flags,
                     Error **errp)
@@ -41,6 +70,7 @@ static int cor_open(BlockDriverState *bs, QDict *options, int flags,
     BDRVStateCOR *state = bs->opaque;
     /* Find a bottom node name, if any */
     const char *bottom_node = qdict_get_try_str(options, "bottom");
+    QemuOpts *opts;
 
     bs->file = bdrv_open_child(NULL, options, "file", bs, &child_of_bds,
                                BDRV_CHILD_FILTERED | BDRV_CHILD_PRIMARY,
@@ -49,6 +79,20 @@ static int cor_open(BlockDriverState *bs, QDict *options, int flags,
         return -EINVAL;
     }
 
+    opts = qemu_opts_create(&runtime_opts, NULL, 0, &error_abort);
+    if (!qemu_opts_absorb_qdict(opts, options, errp)) {
+        qemu_opts_del(opts);
+        return -EINVAL;
+    }
+    state->readahead = qemu_opt_get_size(opts, COR_OPT_READAHEAD, 0);
+    qemu_opts_del(opts);
+
+    if (state->readahead > BDRV_REQUEST_MAX_BYTES) {
+        error_setg(errp, "readahead parameter of copy-on-read filter "
+                   "must not exceed %" PRId64, BDRV_REQUEST_MAX_BYTES);
+        return -EINVAL;
+    }
+
     bs->supported_read_flags = BDRV_REQ_PREFETCH;
 
     bs->supported_write_flags = BDRV_REQ_WRITE_UNCHANGED |
@@ -127,6 +171,84 @@ static int64_t cor_getlength(BlockDriverState *bs)
 }
 
 
+static int coroutine_fn cor_co_preadv_part(BlockDriverState *bs,
+                                           int64_t offset, int64_t bytes,
+                                           QEMUIOVector *qiov,
+                                           size_t qiov_offset,
+                                           BdrvRequestFlags flags);
+
+static void coroutine_fn cor_readahead_entry(void *opaque)
+{
+    CORReadahead *ra = opaque;
+    BlockDriverState *bs = ra->bs;
+    BDRVStateCOR *state = bs->opaque;
+    int ret;
+
+    /*
+     * Errors are ignored: the guest read that needs the data will copy it
+     * itself and report any error.
+     */
+    ret = cor_co_preadv_part(bs, ra->offset, ra->bytes, NULL, 0,
+                             BDRV_REQ_PREFETCH);
+    trace_cor_readahead_done(bs, ra->offset, ra->bytes, ret);
+
+    state->readahead_in_flight = false;
+    bdrv_dec_in_flight(bs);
+    g_free(ra);
+}
+
+/*
+ * Detect sequential guest reads and copy the data that follows them from
+ * the backing chain in the background, one window of @readahead bytes at a
+ * time, so that the following reads hit the top layer.
+ */
+static void cor_readahead(BlockDriverState *bs, int64_t offset, int64_t bytes)
+{
+    BDRVStateCOR *state = bs->opaque;
+    int64_t end = offset + bytes;
+    int64_t start, len;
+    CORReadahead *ra;
+
+    if (offset != state->seq_end) {
+        /* Not sequential, start over */
+        state->seq_end = end;
+        state->readahead_end = end;
+        return;
+    }
+    state->seq_end = end;
+
+    /* Start the next window once half of the current one has been read */
+    if (state->readahead_in_flight ||
+        end + state->readahead / 2 < state->readahead_end) {
+        return;
+    }
+
+    len = bdrv_getlength(bs);
+    if (len < 0) {
+        return;
+    }
+
+    start = MAX(state->readahead_end, end);
+    end = MIN(end + state->readahead, len);
+    if (start >= end) {
+        return;
+    }
+
+    trace_cor_readahead(bs, start, end - start);
+    state->readahead_end = end;
+    state->readahead_in_flight = true;
+
+    ra = g_new(CORReadahead, 1);
+    *ra = (CORReadahead) {
+        .bs = bs,
+        .offset = start,
+        .bytes = end - start,
+    };
+    bdrv_inc_in_flight(bs);
+    aio_co_enter(bdrv_get_aio_context(bs),
+                 qemu_coroutine_create(cor_readahead_entry, ra));
+}
+
 static int coroutine_fn cor_co_preadv_part(BlockDriverState *bs,
                                            int64_t offset, int64_t bytes,
                                            QEMUIOVector *qiov,
@@ -138,6 +260,10 @@ static int coroutine_fn cor_co_preadv_part(BlockDriverState *bs,
     int ret;
     BDRVStateCOR *state = bs->opaque;
 
+    if (state->readahead && !(flags & BDRV_REQ_PREFETCH)) {
+        cor_readahead(bs, offset, bytes);
+    }
+
     if (!state->bottom_bs) {
         return bdrv_co_preadv_part(bs->file, offset, bytes, qiov, qiov_offset,
                                    flags | BDRV_REQ_COPY_ON_READ);
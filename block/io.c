@@ -1800,6 +1800,20 @@ int coroutine_fn bdrv_co_preadv(BdrvChild *child,
     return bdrv_co_preadv_part(child, offset, bytes, qiov, 0, flags);
 }
 
+static void bdrv_latency_account(BdrvLatencyStats *stats, int64_t start_ns)
+{
+    int64_t ns = qemu_clock_get_ns(QEMU_CLOCK_REALTIME) - start_ns;
+    int bin = 0;
+
+    if (ns >= (1LL << BDRV_LATENCY_MIN_SHIFT)) {
+        bin = 63 - clz64(ns) - BDRV_LATENCY_MIN_SHIFT + 1;
+        bin = MIN(bin, BDRV_LATENCY_BINS - 1);
+    }
+
+    stat64_add(&stats->total_ns, MAX(ns, 0));
+    stat64_add(&stats->bins[bin], 1);
+}
+
 int coroutine_fn bdrv_co_preadv_part(BdrvChild *child,
     int64_t offset, int64_t bytes,
     QEMUIOVector *qiov, size_t qiov_offset,
@@ -1808,6 +1822,7 @@ int coroutine_fn bdrv_co_preadv_part(BdrvChild *child,
     BlockDriverState *bs = child->bs;
     BdrvTrackedRequest req;
     BdrvRequestPadding pad;
+    int64_t start_ns;
     int ret;
 
     trace_bdrv_co_preadv_part(bs, offset, bytes, flags);
@@ -1834,6 +1849,7 @@ int coroutine_fn bdrv_co_preadv_part(BdrvChild *child,
     }
 
     bdrv_inc_in_flight(bs);
+    start_ns = qemu_clock_get_ns(QEMU_CLOCK_REALTIME);
 
     /* Don't do copy-on-read if we read data before write operation */
     if (qatomic_read(&bs->copy_on_read)) {
@@ -1854,6 +1870,7 @@ int coroutine_fn bdrv_co_preadv_part(BdrvChild *child,
     bdrv_padding_destroy(&pad);
 
 fail:
+    bdrv_latency_account(&bs->rd_latency, start_ns);
     bdrv_dec_in_flight(bs);
 
     return ret;
@@ -2241,6 +2258,7 @@ int coroutine_fn bdrv_co_pwritev_part(BdrvChild *child,
     BdrvTrackedRequest req;
     uint64_t align = bs->bl.request_alignment;
     BdrvRequestPadding pad;
+    int64_t start_ns;
     int ret;
     bool padded = false;
 
@@ -2292,6 +2310,7 @@ int coroutine_fn bdrv_co_pwritev_part(BdrvChild *child,
     }
 
     bdrv_inc_in_flight(bs);
+    start_ns = qemu_clock_get_ns(QEMU_CLOCK_REALTIME);
     tracked_request_begin(&req, bs, offset, bytes, BDRV_TRACKED_WRITE);
 
     if (flags & BDRV_REQ_ZERO_WRITE) {
@@ -2318,6 +2337,7 @@ int coroutine_fn bdrv_co_pwritev_part(BdrvChild *child,
 
 out:
     tracked_request_end(&req);
+    bdrv_latency_account(&bs->wr_latency, start_ns);
     bdrv_dec_in_flight(bs);
 
     return ret;
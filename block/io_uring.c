@@ -22,6 +22,9 @@
 /* io_uring ring size */
 #define MAX_ENTRIES 128
 
+/* default number of sqes to queue up before submitting while plugged */
+#define DEFAULT_MAX_BATCH 32
+
 typedef struct LuringAIOCB {
     Coroutine *co;
     struct io_uring_sqe sqeq;
@@ -311,18 +314,37 @@ static void ioq_init(LuringQueue *io_q)
     io_q->blocked = false;
 }
 
+static uint64_t luring_max_batch(LuringState *s, uint64_t dev_max_batch)
+{
+    uint64_t max_batch = s->aio_context->aio_max_batch ?: DEFAULT_MAX_BATCH;
+
+    /*
+     * AIO context can be shared between multiple block devices, so
+     * `dev_max_batch` allows reducing the batch size for latency-sensitive
+     * devices.
+     */
+    max_batch = MIN_NON_ZERO(dev_max_batch, max_batch);
+
+    /* limit the batch with the number of free ring entries */
+    max_batch = MIN_NON_ZERO(MAX_ENTRIES - s->io_q.in_flight, max_batch);
+
+    return max_batch;
+}
+
 void luring_io_plug(BlockDriverState *bs, LuringState *s)
 {
     trace_luring_io_plug(s);
     s->io_q.plugged++;
 }
 
-void luring_io_unplug(BlockDriverState *bs, LuringState *s)
+void luring_io_unplug(BlockDriverState *bs, LuringState *s,
+                      uint64_t dev_max_batch)
 {
     assert(s->io_q.plugged);
     trace_luring_io_unplug(s, s->io_q.blocked, s->io_q.plugged,
                            s->io_q.in_queue, s->io_q.in_flight);
-    if (--s->io_q.plugged == 0 &&
+    if ((--s->io_q.plugged == 0 ||
+         s->io_q.in_queue >= luring_max_batch(s, dev_max_batch)) &&
         !s->io_q.blocked && s->io_q.in_queue > 0) {
         ioq_submit(s);
     }
@@ -335,12 +357,15 @@ void luring_io_unplug(BlockDriverState *bs, LuringState *s)
  * @s: AIO state
  * @offset: offset for request
  * @type: type of request
+ * @dev_max_batch: per-device limit on the number of queued requests
  *
- * Fetches sqes from ring, adds to pending queue and preps them
+ * Fetches sqes from ring, adds to pending queue and preps them.  While
+ * plugged, the queue is flushed to the kernel as soon as it holds a full
+ * batch, so that a long plugged section does not leave the device idle.
  *
  */
 static int luring_do_submit(int fd, LuringAIOCB *luringcb, LuringState *s,
-                            uint64_t offset, int type)
+                            uint64_t offset, int type, uint64_t dev_max_batch)
 {
     int ret;
     struct io_uring_sqe *sqes = &luringcb->sqeq;
@@ -370,7 +395,7 @@ static int luring_do_submit(int fd, LuringAIOCB *luringcb, LuringState *s,
                            s->io_q.in_queue, s->io_q.in_flight);
     if (!s->io_q.blocked &&
         (!s->io_q.plugged ||
-         s->io_q.in_flight + s->io_q.in_queue >= MAX_ENTRIES)) {
+         s->io_q.in_queue >= luring_max_batch(s, dev_max_batch))) {
         ret = ioq_submit(s);
         trace_luring_do_submit_done(s, ret);
         return ret;
@@ -379,7 +404,8 @@ static int luring_do_submit(int fd, LuringAIOCB *luringcb, LuringState *s,
 }
 
 int coroutine_fn luring_co_submit(BlockDriverState *bs, LuringState *s, int fd,
-                                  uint64_t offset, QEMUIOVector *qiov, int type)
+                                  uint64_t offset, QEMUIOVector *qiov, int type,
+                                  uint64_t dev_max_batch)
 {
     int ret;
     LuringAIOCB luringcb = {
@@ -390,7 +416,7 @@ int coroutine_fn luring_co_submit(BlockDriverState *bs, LuringState *s, int fd,
     };
     trace_luring_co_submit(bs, s, &luringcb, fd, offset, qiov ? qiov->size : 0,
                            type);
-    ret = luring_do_submit(fd, &luringcb, s, offset, type);
+    ret = luring_do_submit(fd, &luringcb, s, offset, type, dev_max_batch);
 
     if (ret < 0) {
         return ret;
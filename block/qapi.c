@@ -661,6 +661,44 @@ BlockStatsList *qmp_query_blockstats(bool has_query_nodes,
     return head;
 }
 
+static BlockLatencyStats *bdrv_query_latency(BdrvLatencyStats *stats)
+{
+    BlockLatencyStats *ls = g_new0(BlockLatencyStats, 1);
+    BlockLatencyHistogramInfo *hist = g_new0(BlockLatencyHistogramInfo, 1);
+    uint64List **boundaries = &hist->boundaries;
+    uint64List **bins = &hist->bins;
+    int i;
+
+    for (i = 0; i < BDRV_LATENCY_BINS; i++) {
+        if (i < BDRV_LATENCY_BINS - 1) {
+            QAPI_LIST_APPEND(boundaries,
+                             1ULL << (BDRV_LATENCY_MIN_SHIFT + i));
+        }
+        QAPI_LIST_APPEND(bins, stat64_get(&stats->bins[i]));
+    }
+
+    ls->total_time_ns = stat64_get(&stats->total_ns);
+    ls->histogram = hist;
+    return ls;
+}
+
+BlockNodeLatencyList *qmp_x_query_block_latency(Error **errp)
+{
+    BlockNodeLatencyList *head = NULL, **tail = &head;
+    BlockDriverState *bs;
+
+    for (bs = bdrv_next_node(NULL); bs; bs = bdrv_next_node(bs)) {
+        BlockNodeLatency *nl = g_new0(BlockNodeLatency, 1);
+
+        nl->node_name = g_strdup(bdrv_get_node_name(bs));
+        nl->rd = bdrv_query_latency(&bs->rd_latency);
+        nl->wr = bdrv_query_latency(&bs->wr_latency);
+        QAPI_LIST_APPEND(tail, nl);
+    }
+
+    return head;
+}
+
 void bdrv_snapshot_dump(QEMUSnapshotInfo *sn)
 {
     char clock_buf[128];
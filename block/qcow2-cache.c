@@ -26,11 +26,21 @@
 #include "qcow2.h"
 #include "trace.h"
 
+/*
+ * Cached tables are found through a hash index on their offset.  Tables that
+ * are not in use (ref == 0) are kept on a doubly linked LRU list, least
+ * recently used first, with empty entries at the very front.  This makes
+ * both lookups and evictions O(1) regardless of the cache size.  Links are
+ * entry indices, -1 terminates a list.
+ */
 typedef struct Qcow2CachedTable {
     int64_t  offset;
     uint64_t lru_counter;
     int      ref;
     bool     dirty;
+    int      hash_next;
+    int      lru_prev;
+    int      lru_next;
 } Qcow2CachedTable;
 
 struct Qcow2Cache {
@@ -42,6 +52,13 @@ struct Qcow2Cache {
     void                   *table_array;
     uint64_t                lru_counter;
     uint64_t                cache_clean_lru_counter;
+    int                    *hash_buckets;
+    unsigned                hash_mask;
+    int                     lru_head;
+    int                     lru_tail;
+    uint64_t                hits;
+    uint64_t                misses;
+    uint64_t                evictions;
 };
 
 static inline void *qcow2_cache_get_table_addr(Qcow2Cache *c, int table)
@@ -84,6 +101,121 @@ static void qcow2_cache_table_release(Qcow2Cache *c, int i, int num_tables)
 #endif
 }
 
+static inline unsigned qcow2_cache_hash(Qcow2Cache *c, uint64_t offset)
+{
+    return (offset / c->table_size) & c->hash_mask;
+}
+
+static int qcow2_cache_lookup(Qcow2Cache *c, uint64_t offset)
+{
+    int i = c->hash_buckets[qcow2_cache_hash(c, offset)];
+
+    while (i != -1 && c->entries[i].offset != offset) {
+        i = c->entries[i].hash_next;
+    }
+    return i;
+}
+
+static void qcow2_cache_hash_insert(Qcow2Cache *c, int i)
+{
+    int *bucket = &c->hash_buckets[qcow2_cache_hash(c, c->entries[i].offset)];
+
+    c->entries[i].hash_next = *bucket;
+    *bucket = i;
+}
+
+static void qcow2_cache_hash_remove(Qcow2Cache *c, int i)
+{
+    int *link = &c->hash_buckets[qcow2_cache_hash(c, c->entries[i].offset)];
+
+    while (*link != i) {
+        assert(*link != -1);
+        link = &c->entries[*link].hash_next;
+    }
+    *link = c->entries[i].hash_next;
+    c->entries[i].hash_next = -1;
+}
+
+static void qcow2_cache_lru_remove(Qcow2Cache *c, int i)
+{
+    Qcow2CachedTable *t = &c->entries[i];
+
+    if (t->lru_prev != -1) {
+        c->entries[t->lru_prev].lru_next = t->lru_next;
+    } else {
+        c->lru_head = t->lru_next;
+    }
+    if (t->lru_next != -1) {
+        c->entries[t->lru_next].lru_prev = t->lru_prev;
+    } else {
+        c->lru_tail = t->lru_prev;
+    }
+    t->lru_prev = t->lru_next = -1;
+}
+
+/* Most recently used tables go to the back of the list */
+static void qcow2_cache_lru_add_tail(Qcow2Cache *c, int i)
+{
+    Qcow2CachedTable *t = &c->entries[i];
+
+    t->lru_prev = c->lru_tail;
+    t->lru_next = -1;
+    if (c->lru_tail != -1) {
+        c->entries[c->lru_tail].lru_next = i;
+    } else {
+        c->lru_head = i;
+    }
+    c->lru_tail = i;
+}
+
+/* Empty entries go to the front so that they are reused first */
+static void qcow2_cache_lru_add_head(Qcow2Cache *c, int i)
+{
+    Qcow2CachedTable *t = &c->entries[i];
+
+    t->lru_prev = -1;
+    t->lru_next = c->lru_head;
+    if (c->lru_head != -1) {
+        c->entries[c->lru_head].lru_prev = i;
+    } else {
+        c->lru_tail = i;
+    }
+    c->lru_head = i;
+}
+
+/* Drop the table in unused entry @i, making it the next one to be reused */
+static void qcow2_cache_entry_clear(Qcow2Cache *c, int i)
+{
+    assert(c->entries[i].ref == 0);
+
+    if (c->entries[i].offset) {
+        qcow2_cache_hash_remove(c, i);
+    }
+    c->entries[i].offset = 0;
+    c->entries[i].lru_counter = 0;
+
+    qcow2_cache_lru_remove(c, i);
+    qcow2_cache_lru_add_head(c, i);
+}
+
+/* Put all entries back in their initial, empty state */
+static void qcow2_cache_reset_index(Qcow2Cache *c)
+{
+    int i;
+
+    for (i = 0; i <= c->hash_mask; i++) {
+        c->hash_buckets[i] = -1;
+    }
+
+    c->lru_head = c->lru_tail = -1;
+    for (i = 0; i < c->size; i++) {
+        c->entries[i].offset = 0;
+        c->entries[i].lru_counter = 0;
+        c->entries[i].hash_next = -1;
+        qcow2_cache_lru_add_tail(c, i);
+    }
+}
+
 static inline bool can_clean_entry(Qcow2Cache *c, int i)
 {
     Qcow2CachedTable *t = &c->entries[i];
@@ -104,8 +236,7 @@ void qcow2_cache_clean_unused(Qcow2Cache *c)
 
         /* And count how many we can clean in a row */
         while (i < c->size && can_clean_entry(c, i)) {
-            c->entries[i].offset = 0;
-            c->entries[i].lru_counter = 0;
+            qcow2_cache_entry_clear(c, i);
             i++;
             to_clean++;
         }
@@ -132,17 +263,22 @@ Qcow2Cache *qcow2_cache_create(BlockDriverState *bs, int num_tables,
     c = g_new0(Qcow2Cache, 1);
     c->size = num_tables;
     c->table_size = table_size;
+    c->hash_mask = pow2ceil(num_tables) - 1;
     c->entries = g_try_new0(Qcow2CachedTable, num_tables);
+    c->hash_buckets = g_try_new(int, c->hash_mask + 1);
     c->table_array = qemu_try_blockalign(bs->file->bs,
                                          (size_t) num_tables * c->table_size);
 
-    if (!c->entries || !c->table_array) {
+    if (!c->entries || !c->hash_buckets || !c->table_array) {
         qemu_vfree(c->table_array);
+        g_free(c->hash_buckets);
         g_free(c->entries);
         g_free(c);
-        c = NULL;
+        return NULL;
     }
 
+    qcow2_cache_reset_index(c);
+
     return c;
 }
 
@@ -155,6 +291,7 @@ int qcow2_cache_destroy(Qcow2Cache *c)
     }
 
     qemu_vfree(c->table_array);
+    g_free(c->hash_buckets);
     g_free(c->entries);
     g_free(c);
 
@@ -305,10 +442,9 @@ int qcow2_cache_empty(BlockDriverState *bs, Qcow2Cache *c)
 
     for (i = 0; i < c->size; i++) {
         assert(c->entries[i].ref == 0);
-        c->entries[i].offset = 0;
-        c->entries[i].lru_counter = 0;
     }
 
+    qcow2_cache_reset_index(c);
     qcow2_cache_table_release(c, 0, c->size);
 
     c->lru_counter = 0;
@@ -322,9 +458,6 @@ static int qcow2_cache_do_get(BlockDriverState *bs, Qcow2Cache *c,
     BDRVQcow2State *s = bs->opaque;
     int i;
     int ret;
-    int lookup_index;
-    uint64_t min_lru_counter = UINT64_MAX;
-    int min_lru_index = -1;
 
     assert(offset != 0);
 
@@ -339,29 +472,21 @@ static int qcow2_cache_do_get(BlockDriverState *bs, Qcow2Cache *c,
     }
 
     /* Check if the table is already cached */
-    i = lookup_index = (offset / c->table_size * 4) % c->size;
-    do {
-        const Qcow2CachedTable *t = &c->entries[i];
-        if (t->offset == offset) {
-            goto found;
-        }
-        if (t->ref == 0 && t->lru_counter < min_lru_counter) {
-            min_lru_counter = t->lru_counter;
-            min_lru_index = i;
-        }
-        if (++i == c->size) {
-            i = 0;
-        }
-    } while (i != lookup_index);
+    i = qcow2_cache_lookup(c, offset);
+    if (i != -1) {
+        c->hits++;
+        goto found;
+    }
+    c->misses++;
 
-    if (min_lru_index == -1) {
+    if (c->lru_head == -1) {
         /* This can't happen in current synchronous code, but leave the check
          * here as a reminder for whoever starts using AIO with the cache */
         abort();
     }
 
-    /* Cache miss: write a table back and replace it */
-    i = min_lru_index;
+    /* Cache miss: write back the least recently used table and replace it */
+    i = c->lru_head;
     trace_qcow2_cache_get_replace_entry(qemu_coroutine_self(),
                                         c == s->l2_table_cache, i);
 
@@ -372,7 +497,10 @@ static int qcow2_cache_do_get(BlockDriverState *bs, Qcow2Cache *c,
 
     trace_qcow2_cache_get_read(qemu_coroutine_self(),
                                c == s->l2_table_cache, i);
-    c->entries[i].offset = 0;
+    if (c->entries[i].offset) {
+        c->evictions++;
+    }
+    qcow2_cache_entry_clear(c, i);
     if (read_from_disk) {
         if (c == s->l2_table_cache) {
             BLKDBG_EVENT(bs->file, BLKDBG_L2_LOAD);
@@ -387,10 +515,13 @@ static int qcow2_cache_do_get(BlockDriverState *bs, Qcow2Cache *c,
     }
 
     c->entries[i].offset = offset;
+    qcow2_cache_hash_insert(c, i);
 
     /* And return the right table */
 found:
-    c->entries[i].ref++;
+    if (c->entries[i].ref++ == 0) {
+        qcow2_cache_lru_remove(c, i);
+    }
     *table = qcow2_cache_get_table_addr(c, i);
 
     trace_qcow2_cache_get_done(qemu_coroutine_self(),
@@ -411,6 +542,27 @@ int qcow2_cache_get_empty(BlockDriverState *bs, Qcow2Cache *c, uint64_t offset,
     return qcow2_cache_do_get(bs, c, offset, table, false);
 }
 
+/*
+ * Like qcow2_cache_get(), but never reads from disk and never evicts another
+ * entry, so it cannot yield.  Returns -ENOENT if @offset is not cached.
+ */
+int qcow2_cache_get_if_cached(Qcow2Cache *c, uint64_t offset, void **table)
+{
+    int i = qcow2_cache_lookup(c, offset);
+
+    if (i == -1) {
+        return -ENOENT;
+    }
+
+    c->hits++;
+    if (c->entries[i].ref++ == 0) {
+        qcow2_cache_lru_remove(c, i);
+    }
+    *table = qcow2_cache_get_table_addr(c, i);
+
+    return 0;
+}
+
 void qcow2_cache_put(Qcow2Cache *c, void **table)
 {
     int i = qcow2_cache_get_table_idx(c, *table);
@@ -420,6 +572,7 @@ void qcow2_cache_put(Qcow2Cache *c, void **table)
 
     if (c->entries[i].ref == 0) {
         c->entries[i].lru_counter = ++c->lru_counter;
+        qcow2_cache_lru_add_tail(c, i);
     }
 
     assert(c->entries[i].ref >= 0);
@@ -434,14 +587,9 @@ void qcow2_cache_entry_mark_dirty(Qcow2Cache *c, void *table)
 
 void *qcow2_cache_is_table_offset(Qcow2Cache *c, uint64_t offset)
 {
-    int i;
+    int i = qcow2_cache_lookup(c, offset);
 
-    for (i = 0; i < c->size; i++) {
-        if (c->entries[i].offset == offset) {
-            return qcow2_cache_get_table_addr(c, i);
-        }
-    }
-    return NULL;
+    return i != -1 ? qcow2_cache_get_table_addr(c, i) : NULL;
 }
 
 void qcow2_cache_discard(Qcow2Cache *c, void *table)
@@ -450,9 +598,15 @@ void qcow2_cache_discard(Qcow2Cache *c, void *table)
 
     assert(c->entries[i].ref == 0);
 
-    c->entries[i].offset = 0;
-    c->entries[i].lru_counter = 0;
+    qcow2_cache_entry_clear(c, i);
     c->entries[i].dirty = false;
 
     qcow2_cache_table_release(c, i, 1);
 }
+
+void qcow2_cache_get_stats(Qcow2Cache *c, Qcow2CacheStats *stats)
+{
+    stats->hits = c->hits;
+    stats->misses = c->misses;
+    stats->evictions = c->evictions;
+}
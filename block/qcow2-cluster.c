@@ -215,6 +215,24 @@ static int l2_load(BlockDriverState *bs, uint64_t offset,
                            (void **)l2_slice);
 }
 
+/*
+ * Like l2_load(), but only succeeds if the slice is already cached.
+ * Returns -EAGAIN otherwise. Never yields.
+ */
+static int l2_load_cached(BlockDriverState *bs, uint64_t offset,
+                          uint64_t l2_offset, uint64_t **l2_slice)
+{
+    BDRVQcow2State *s = bs->opaque;
+    int start_of_slice = l2_entry_size(s) *
+        (offset_to_l2_index(s, offset) - offset_to_l2_slice_index(s, offset));
+    int ret;
+
+    ret = qcow2_cache_get_if_cached(s->l2_table_cache,
+                                    l2_offset + start_of_slice,
+                                    (void **)l2_slice);
+    return ret < 0 ? -EAGAIN : 0;
+}
+
 /*
  * Writes an L1 entry to disk (note that depending on the alignment
  * requirements this function may write more that just one entry in
@@ -579,11 +597,17 @@ static int coroutine_fn do_perform_cow_write(BlockDriverState *bs,
  * file. The subcluster type is stored in *subcluster_type.
  * Compressed clusters are always processed one by one.
  *
+ * If @cached_only is true, only L2 slices that are already in the cache are
+ * used and the function never yields. -EAGAIN is returned if the lookup
+ * would need to read from the image file or has found a corrupted entry;
+ * the caller should then retry with @cached_only set to false.
+ *
  * Returns 0 on success, -errno in error cases.
  */
-int qcow2_get_host_offset(BlockDriverState *bs, uint64_t offset,
-                          unsigned int *bytes, uint64_t *host_offset,
-                          QCow2SubclusterType *subcluster_type)
+static int get_host_offset(BlockDriverState *bs, uint64_t offset,
+                           unsigned int *bytes, uint64_t *host_offset,
+                           QCow2SubclusterType *subcluster_type,
+                           bool cached_only)
 {
     BDRVQcow2State *s = bs->opaque;
     unsigned int l2_index, sc_index;
@@ -625,6 +649,9 @@ int qcow2_get_host_offset(BlockDriverState *bs, uint64_t offset,
     }
 
     if (offset_into_cluster(s, l2_offset)) {
+        if (cached_only) {
+            return -EAGAIN;
+        }
         qcow2_signal_corruption(bs, true, -1, -1, "L2 table offset %#" PRIx64
                                 " unaligned (L1 index: %#" PRIx64 ")",
                                 l2_offset, l1_index);
@@ -633,7 +660,11 @@ int qcow2_get_host_offset(BlockDriverState *bs, uint64_t offset,
 
     /* load the l2 slice in memory */
 
-    ret = l2_load(bs, offset, l2_offset, &l2_slice);
+    if (cached_only) {
+        ret = l2_load_cached(bs, offset, l2_offset, &l2_slice);
+    } else {
+        ret = l2_load(bs, offset, l2_offset, &l2_slice);
+    }
     if (ret < 0) {
         return ret;
     }
@@ -654,6 +685,10 @@ int qcow2_get_host_offset(BlockDriverState *bs, uint64_t offset,
     type = qcow2_get_subcluster_type(bs, l2_entry, l2_bitmap, sc_index);
     if (s->qcow_version < 3 && (type == QCOW2_SUBCLUSTER_ZERO_PLAIN ||
                                 type == QCOW2_SUBCLUSTER_ZERO_ALLOC)) {
+        if (cached_only) {
+            ret = -EAGAIN;
+            goto fail;
+        }
         qcow2_signal_corruption(bs, true, -1, -1, "Zero cluster entry found"
                                 " in pre-v3 image (L2 offset: %#" PRIx64
                                 ", L2 index: %#x)", l2_offset, l2_index);
@@ -665,6 +700,10 @@ int qcow2_get_host_offset(BlockDriverState *bs, uint64_t offset,
         break; /* This is handled by count_contiguous_subclusters() below */
     case QCOW2_SUBCLUSTER_COMPRESSED:
         if (has_data_file(bs)) {
+            if (cached_only) {
+                ret = -EAGAIN;
+                goto fail;
+            }
             qcow2_signal_corruption(bs, true, -1, -1, "Compressed cluster "
                                     "entry found in image with external data "
                                     "file (L2 offset: %#" PRIx64 ", L2 index: "
@@ -683,6 +722,10 @@ int qcow2_get_host_offset(BlockDriverState *bs, uint64_t offset,
         uint64_t host_cluster_offset = l2_entry & L2E_OFFSET_MASK;
         *host_offset = host_cluster_offset + offset_in_cluster;
         if (offset_into_cluster(s, host_cluster_offset)) {
+            if (cached_only) {
+                ret = -EAGAIN;
+                goto fail;
+            }
             qcow2_signal_corruption(bs, true, -1, -1,
                                     "Cluster allocation offset %#"
                                     PRIx64 " unaligned (L2 offset: %#" PRIx64
@@ -692,6 +735,10 @@ int qcow2_get_host_offset(BlockDriverState *bs, uint64_t offset,
             goto fail;
         }
         if (has_data_file(bs) && *host_offset != offset) {
+            if (cached_only) {
+                ret = -EAGAIN;
+                goto fail;
+            }
             qcow2_signal_corruption(bs, true, -1, -1,
                                     "External data file host cluster offset %#"
                                     PRIx64 " does not match guest cluster "
@@ -710,6 +757,10 @@ int qcow2_get_host_offset(BlockDriverState *bs, uint64_t offset,
     sc = count_contiguous_subclusters(bs, nb_clusters, sc_index,
                                       l2_slice, &l2_index);
     if (sc < 0) {
+        if (cached_only) {
+            ret = -EAGAIN;
+            goto fail;
+        }
         qcow2_signal_corruption(bs, true, -1, -1, "Invalid cluster entry found "
                                 " (L2 offset: %#" PRIx64 ", L2 index: %#x)",
                                 l2_offset, l2_index);
@@ -740,6 +791,26 @@ fail:
     return ret;
 }
 
+int qcow2_get_host_offset(BlockDriverState *bs, uint64_t offset,
+                          unsigned int *bytes, uint64_t *host_offset,
+                          QCow2SubclusterType *subcluster_type)
+{
+    return get_host_offset(bs, offset, bytes, host_offset, subcluster_type,
+                           false);
+}
+
+/*
+ * Lock-free variant of qcow2_get_host_offset() that can be called without
+ * holding s->lock. See get_host_offset() for the meaning of -EAGAIN.
+ */
+int qcow2_get_host_offset_cached(BlockDriverState *bs, uint64_t offset,
+                                 unsigned int *bytes, uint64_t *host_offset,
+                                 QCow2SubclusterType *subcluster_type)
+{
+    return get_host_offset(bs, offset, bytes, host_offset, subcluster_type,
+                           true);
+}
+
 /*
  * get_cluster_table
  *
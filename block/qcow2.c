@@ -316,7 +316,7 @@ static int qcow2_read_extensions(BlockDriverState *bs, uint64_t start_offset,
             }
             s->crypto = qcrypto_block_open(s->crypto_opts, "encrypt.",
                                            qcow2_crypto_hdr_read_func,
-                                           bs, cflags, QCOW2_MAX_THREADS, errp);
+                                           bs, cflags, s->max_threads, errp);
             if (!s->crypto) {
                 return -EINVAL;
             }
@@ -1306,6 +1306,10 @@ static int coroutine_fn qcow2_do_open(BlockDriverState *bs, QDict *options,
     uint64_t l1_vm_state_index;
     bool update_header = false;
 
+    /* This is also the number of cipher instances for encrypted images */
+    s->max_threads = MIN(MAX(g_get_num_processors(), QCOW2_MIN_THREADS),
+                         QCOW2_MAX_THREADS);
+
     ret = bdrv_pread(bs->file, 0, &header, sizeof(header));
     if (ret < 0) {
         error_setg_errno(errp, -ret, "Could not read qcow2 header");
@@ -1672,7 +1676,7 @@ static int coroutine_fn qcow2_do_open(BlockDriverState *bs, QDict *options,
             }
             s->crypto = qcrypto_block_open(s->crypto_opts, "encrypt.",
                                            NULL, NULL, cflags,
-                                           QCOW2_MAX_THREADS, errp);
+                                           s->max_threads, errp);
             if (!s->crypto) {
                 ret = -EINVAL;
                 goto fail;
@@ -2330,10 +2334,19 @@ static coroutine_fn int qcow2_co_preadv_part(BlockDriverState *bs,
                             QCOW_MAX_CRYPT_CLUSTERS * s->cluster_size);
         }
 
-        qemu_co_mutex_lock(&s->lock);
-        ret = qcow2_get_host_offset(bs, offset, &cur_bytes,
-                                    &host_offset, &type);
-        qemu_co_mutex_unlock(&s->lock);
+        /*
+         * Mappings whose L2 slice is cached are resolved without taking
+         * s->lock, so that reads do not queue up behind allocating writes
+         * that hold the lock across metadata I/O.
+         */
+        ret = qcow2_get_host_offset_cached(bs, offset, &cur_bytes,
+                                           &host_offset, &type);
+        if (ret == -EAGAIN) {
+            qemu_co_mutex_lock(&s->lock);
+            ret = qcow2_get_host_offset(bs, offset, &cur_bytes,
+                                        &host_offset, &type);
+            qemu_co_mutex_unlock(&s->lock);
+        }
         if (ret < 0) {
             goto out;
         }
@@ -4668,7 +4681,8 @@ qcow2_co_pwritev_compressed_part(BlockDriverState *bs,
         uint64_t chunk_size = MIN(bytes, s->cluster_size);
 
         if (!aio && chunk_size != bytes) {
-            aio = aio_task_pool_new(QCOW2_MAX_WORKERS);
+            /* Keep all compression threads busy with a single request */
+            aio = aio_task_pool_new(MAX(QCOW2_MAX_WORKERS, s->max_threads));
         }
 
         ret = qcow2_add_task(bs, aio, qcow2_co_pwritev_compressed_task_entry,
@@ -5119,6 +5133,26 @@ static int qcow2_get_info(BlockDriverState *bs, BlockDriverInfo *bdi)
     return 0;
 }
 
+static BlockStatsSpecific *qcow2_get_specific_stats(BlockDriverState *bs)
+{
+    BDRVQcow2State *s = bs->opaque;
+    BlockStatsSpecific *stats = g_new0(BlockStatsSpecific, 1);
+
+    stats->driver = BLOCKDEV_DRIVER_QCOW2;
+    stats->u.qcow2.l2_cache = g_new0(Qcow2CacheStats, 1);
+    stats->u.qcow2.refcount_cache = g_new0(Qcow2CacheStats, 1);
+
+    if (s->l2_table_cache) {
+        qcow2_cache_get_stats(s->l2_table_cache, stats->u.qcow2.l2_cache);
+    }
+    if (s->refcount_block_cache) {
+        qcow2_cache_get_stats(s->refcount_block_cache,
+                              stats->u.qcow2.refcount_cache);
+    }
+
+    return stats;
+}
+
 static ImageInfoSpecific *qcow2_get_specific_info(BlockDriverState *bs,
                                                   Error **errp)
 {
@@ -6048,6 +6082,7 @@ BlockDriver bdrv_qcow2 = {
     .bdrv_measure           = qcow2_measure,
     .bdrv_get_info          = qcow2_get_info,
     .bdrv_get_specific_info = qcow2_get_specific_info,
+    .bdrv_get_specific_stats = qcow2_get_specific_stats,
 
     .bdrv_save_vmstate    = qcow2_save_vmstate,
     .bdrv_load_vmstate    = qcow2_load_vmstate,
@@ -321,7 +321,13 @@ typedef struct Qcow2BitmapHeaderExt {
     uint64_t bitmap_directory_offset;
 } QEMU_PACKED Qcow2BitmapHeaderExt;
 
-#define QCOW2_MAX_THREADS 4
+/*
+ * Bounds for the number of threads that compress, decompress, encrypt or
+ * decrypt clusters of one image at the same time; the actual limit follows
+ * the number of host CPUs.
+ */
+#define QCOW2_MIN_THREADS 4
+#define QCOW2_MAX_THREADS 64
 
 typedef struct BDRVQcow2State {
     int cluster_bits;
@@ -407,6 +413,7 @@ typedef struct BDRVQcow2State {
 
     CoQueue thread_task_queue;
     int nb_threads;
+    int max_threads;
 
     BdrvChild *data_file;
 
@@ -908,6 +915,9 @@ int qcow2_encrypt_sectors(BDRVQcow2State *s, int64_t sector_num,
 int qcow2_get_host_offset(BlockDriverState *bs, uint64_t offset,
                           unsigned int *bytes, uint64_t *host_offset,
                           QCow2SubclusterType *subcluster_type);
+int qcow2_get_host_offset_cached(BlockDriverState *bs, uint64_t offset,
+                                 unsigned int *bytes, uint64_t *host_offset,
+                                 QCow2SubclusterType *subcluster_type);
 int qcow2_alloc_host_offset(BlockDriverState *bs, uint64_t offset,
                             unsigned int *bytes, uint64_t *host_offset,
                             QCowL2Meta **m);
@@ -973,9 +983,11 @@ int qcow2_cache_get(BlockDriverState *bs, Qcow2Cache *c, uint64_t offset,
     void **table);
 int qcow2_cache_get_empty(BlockDriverState *bs, Qcow2Cache *c, uint64_t offset,
     void **table);
+int qcow2_cache_get_if_cached(Qcow2Cache *c, uint64_t offset, void **table);
 void qcow2_cache_put(Qcow2Cache *c, void **table);
 void *qcow2_cache_is_table_offset(Qcow2Cache *c, uint64_t offset);
 void qcow2_cache_discard(Qcow2Cache *c, void *table);
+void qcow2_cache_get_stats(Qcow2Cache *c, Qcow2CacheStats *stats);
 
 /* qcow2-bitmap.c functions */
 int qcow2_check_bitmaps_refcounts(BlockDriverState *bs, BdrvCheckResult *res,
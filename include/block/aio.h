@@ -22,6 +22,7 @@
 #include "qemu/event_notifier.h"
 #include "qemu/thread.h"
 #include "qemu/timer.h"
+#include "qemu/stats64.h"
 
 typedef struct BlockAIOCB BlockAIOCB;
 typedef void BlockCompletionFunc(void *opaque, int ret);
@@ -121,6 +122,9 @@ struct BHListSlice {
 
 typedef QSLIST_HEAD(, AioHandler) AioHandlerSList;
 
+/* Wait times above 2^31 ns (about 2 seconds) share the last bucket */
+#define AIO_POLL_HIST_BUCKETS 32
+
 struct AioContext {
     GSource source;
 
@@ -231,6 +235,19 @@ struct AioContext {
     int64_t poll_max_ns;    /* maximum polling time in nanoseconds */
     int64_t poll_grow;      /* polling time growth factor */
     int64_t poll_shrink;    /* polling time shrink factor */
+    int64_t poll_hit_target; /* % of events polling should catch, 0 = off */
+
+    /*
+     * Histogram of aio_poll() wait times used when poll_hit_target is set.
+     * Bucket i counts waits of [2^i, 2^(i+1)) nanoseconds.
+     */
+    uint32_t poll_hist[AIO_POLL_HIST_BUCKETS];
+    uint32_t poll_hist_samples;
+
+    /* Polling statistics, only updated by the home thread */
+    Stat64 poll_hits;       /* polling made progress */
+    Stat64 poll_misses;     /* polling timed out without progress */
+    Stat64 poll_wasted_ns;  /* time spent in polling that timed out */
 
     /* AIO engine parameters */
     int64_t aio_max_batch;  /* maximum number of requests in a batch */
@@ -753,12 +770,14 @@ void aio_context_use_g_source(AioContext *ctx);
  * @max_ns: how long to busy poll for, in nanoseconds
  * @grow: polling time growth factor
  * @shrink: polling time shrink factor
+ * @hit_target: percentage of events that polling should catch, chosen from
+ *              a histogram of recent wait times; 0 uses @grow and @shrink
  *
  * Poll mode can be disabled by setting poll_max_ns to 0.
  */
 void aio_context_set_poll_params(AioContext *ctx, int64_t max_ns,
                                  int64_t grow, int64_t shrink,
-                                 Error **errp);
+                                 int64_t hit_target, Error **errp);
 
 /**
  * aio_context_set_aio_params:
@@ -880,6 +880,20 @@ typedef struct BdrvBlockStatusCache {
     int64_t data_end;
 } BdrvBlockStatusCache;
 
+/*
+ * Latency of the requests that a node has completed.  Bin 0 counts requests
+ * that took less than 2^BDRV_LATENCY_MIN_SHIFT ns, bin i counts requests
+ * that took less than 2^(BDRV_LATENCY_MIN_SHIFT + i) ns, and the last bin
+ * counts everything else.
+ */
+#define BDRV_LATENCY_MIN_SHIFT 10
+#define BDRV_LATENCY_BINS 26
+
+typedef struct BdrvLatencyStats {
+    Stat64 total_ns;
+    Stat64 bins[BDRV_LATENCY_BINS];
+} BdrvLatencyStats;
+
 struct BlockDriverState {
     /* Protected by big QEMU lock or read-only after opening.  No special
      * locking needed during I/O...
@@ -1008,6 +1022,14 @@ struct BlockDriverState {
     /* Offset after the highest byte written to */
     Stat64 wr_highest_offset;
 
+    /*
+     * Latency of read and write requests, including the time spent in the
+     * children, so that comparing a node with its children shows in which
+     * layer the time is spent.
+     */
+    BdrvLatencyStats rd_latency;
+    BdrvLatencyStats wr_latency;
+
     /* If true, copy read backing sectors into image.  Can be >1 if more
      * than one client has requested copy-on-read.  Accessed with atomic
      * ops.
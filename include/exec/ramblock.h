@@ -71,6 +71,16 @@ struct RAMBlock {
      * could not have been valid on the source.
      */
     ram_addr_t postcopy_length;
+
+    /*
+     * With the mapped-ram capability every page of the block has a fixed
+     * place in the migration file: page N lives at pages_offset + N *
+     * TARGET_PAGE_SIZE, and file_bmap (stored at bitmap_offset) tells
+     * which of those pages were written.  Only used on the source.
+     */
+    unsigned long *file_bmap;
+    off_t bitmap_offset;
+    off_t pages_offset;
 };
 #endif
 #endif
@@ -411,6 +411,12 @@ struct CPUState {
      */
     bool throttle_thread_scheduled;
 
+    /*
+     * Sleep percentage for this vcpu when per-vcpu throttling is in use,
+     * see cpu_throttle_set_vcpu().
+     */
+    int throttle_percentage;
+
     bool ignore_memory_transaction_failures;
 
     /* Used for user-only emulation of prctl(PR_SET_UNALIGN). */
@@ -34,10 +34,14 @@ OBJECT_DECLARE_TYPE(QIOChannel, QIOChannelClass,
 
 typedef enum QIOChannelFeature QIOChannelFeature;
 
+#define QIO_CHANNEL_WRITE_FLAG_ZERO_COPY 0x1
+
 enum QIOChannelFeature {
     QIO_CHANNEL_FEATURE_FD_PASS,
     QIO_CHANNEL_FEATURE_SHUTDOWN,
     QIO_CHANNEL_FEATURE_LISTEN,
+    QIO_CHANNEL_FEATURE_WRITE_ZERO_COPY,
+    QIO_CHANNEL_FEATURE_SEEKABLE,
 };
 
 
@@ -104,6 +108,7 @@ struct QIOChannelClass {
                          size_t niov,
                          int *fds,
                          size_t nfds,
+                         int flags,
                          Error **errp);
     ssize_t (*io_readv)(QIOChannel *ioc,
                         const struct iovec *iov,
@@ -131,6 +136,18 @@ struct QIOChannelClass {
                      off_t offset,
                      int whence,
                      Error **errp);
+    int (*io_flush)(QIOChannel *ioc,
+                    Error **errp);
+    ssize_t (*io_preadv)(QIOChannel *ioc,
+                         const struct iovec *iov,
+                         size_t niov,
+                         off_t offset,
+                         Error **errp);
+    ssize_t (*io_pwritev)(QIOChannel *ioc,
+                          const struct iovec *iov,
+                          size_t niov,
+                          off_t offset,
+                          Error **errp);
     void (*io_set_aio_fd_handler)(QIOChannel *ioc,
                                   AioContext *ctx,
                                   IOHandler *io_read,
@@ -228,6 +245,7 @@ ssize_t qio_channel_readv_full(QIOChannel *ioc,
  * @niov: the length of the @iov array
  * @fds: an array of file handles to send
  * @nfds: number of file handles in @fds
+ * @flags: write flags (QIO_CHANNEL_WRITE_FLAG_*)
  * @errp: pointer to a NULL-initialized error object
  *
  * Write data to the IO channel, reading it from the
@@ -251,6 +269,12 @@ ssize_t qio_channel_readv_full(QIOChannel *ioc,
  * unless qio_channel_has_feature() returns a true
  * value for the QIO_CHANNEL_FEATURE_FD_PASS constant.
  *
+ * With QIO_CHANNEL_WRITE_FLAG_ZERO_COPY, which requires
+ * QIO_CHANNEL_FEATURE_WRITE_ZERO_COPY, the data is not
+ * copied but referenced until it reaches the peer: the
+ * memory regions in @iov must not be modified or freed
+ * before a call to qio_channel_flush() returns.
+ *
  * Returns: the number of bytes sent, or -1 on error,
  * or QIO_CHANNEL_ERR_BLOCK if no data is can be sent
  * and the channel is non-blocking
@@ -260,6 +284,7 @@ ssize_t qio_channel_writev_full(QIOChannel *ioc,
                                 size_t niov,
                                 int *fds,
                                 size_t nfds,
+                                int flags,
                                 Error **errp);
 
 /**
@@ -598,6 +623,83 @@ off_t qio_channel_io_seek(QIOChannel *ioc,
                           int whence,
                           Error **errp);
 
+/**
+ * qio_channel_preadv:
+ * @ioc: the channel object
+ * @iov: the array of memory regions to read data into
+ * @niov: the length of the @iov array
+ * @offset: the position in the channel to read from
+ * @errp: pointer to a NULL-initialized error object
+ *
+ * Reads data from @offset without moving the current I/O
+ * position of the channel, as preadv(2). Only channels with
+ * the QIO_CHANNEL_FEATURE_SEEKABLE feature support this, and
+ * like qio_channel_readv() fewer bytes than requested may be
+ * read.
+ *
+ * Returns: the number of bytes read, 0 at end of file,
+ * or -1 on error
+ */
+ssize_t qio_channel_preadv(QIOChannel *ioc,
+                           const struct iovec *iov,
+                           size_t niov,
+                           off_t offset,
+                           Error **errp);
+
+/**
+ * qio_channel_pread:
+ * @ioc: the channel object
+ * @buf: the memory region to read data into
+ * @buflen: the number of bytes to read
+ * @offset: the position in the channel to read from
+ * @errp: pointer to a NULL-initialized error object
+ *
+ * Behaves as qio_channel_preadv() with a single buffer.
+ */
+ssize_t qio_channel_pread(QIOChannel *ioc,
+                          char *buf,
+                          size_t buflen,
+                          off_t offset,
+                          Error **errp);
+
+/**
+ * qio_channel_pwritev:
+ * @ioc: the channel object
+ * @iov: the array of memory regions to write data from
+ * @niov: the length of the @iov array
+ * @offset: the position in the channel to write to
+ * @errp: pointer to a NULL-initialized error object
+ *
+ * Writes data at @offset without moving the current I/O
+ * position of the channel, as pwritev(2). Only channels with
+ * the QIO_CHANNEL_FEATURE_SEEKABLE feature support this, and
+ * like qio_channel_writev() fewer bytes than requested may be
+ * written.
+ *
+ * Returns: the number of bytes written, or -1 on error
+ */
+ssize_t qio_channel_pwritev(QIOChannel *ioc,
+                            const struct iovec *iov,
+                            size_t niov,
+                            off_t offset,
+                            Error **errp);
+
+/**
+ * qio_channel_pwrite:
+ * @ioc: the channel object
+ * @buf: the memory region to write data from
+ * @buflen: the number of bytes to write
+ * @offset: the position in the channel to write to
+ * @errp: pointer to a NULL-initialized error object
+ *
+ * Behaves as qio_channel_pwritev() with a single buffer.
+ */
+ssize_t qio_channel_pwrite(QIOChannel *ioc,
+                           const char *buf,
+                           size_t buflen,
+                           off_t offset,
+                           Error **errp);
+
 
 /**
  * qio_channel_create_watch:
@@ -837,6 +939,7 @@ int qio_channel_readv_full_all(QIOChannel *ioc,
  * @niov: the length of the @iov array
  * @fds: an array of file handles to send
  * @nfds: number of file handles in @fds
+ * @flags: write flags (QIO_CHANNEL_WRITE_FLAG_*)
  * @errp: pointer to a NULL-initialized error object
  *
  *
@@ -853,6 +956,22 @@ int qio_channel_writev_full_all(QIOChannel *ioc,
                                 const struct iovec *iov,
                                 size_t niov,
                                 int *fds, size_t nfds,
-                                Error **errp);
+                                int flags, Error **errp);
+
+/**
+ * qio_channel_flush:
+ * @ioc: the channel object
+ * @errp: pointer to a NULL-initialized error object
+ *
+ * Wait until every write issued with QIO_CHANNEL_WRITE_FLAG_ZERO_COPY
+ * is done with the caller's memory.  Channels without zero copy
+ * support return immediately.
+ *
+ * Returns: 0 if at least part of the data was actually sent without
+ * copying, 1 if the kernel fell back to copying all of it, or -1 on
+ * error
+ */
+int qio_channel_flush(QIOChannel *ioc,
+                      Error **errp);
 
 #endif /* QIO_CHANNEL_H */
@@ -44,6 +44,13 @@ struct VMStateInfo {
     int (*get)(QEMUFile *f, void *pv, size_t size, const VMStateField *field);
     int (*put)(QEMUFile *f, void *pv, size_t size, const VMStateField *field,
                JSONWriter *vmdesc);
+    /*
+     * Optional: transfer @n elements that are @size bytes apart in one
+     * go.  The wire format must be the same as calling get/put on each
+     * element in turn.
+     */
+    int (*get_array)(QEMUFile *f, void *pv, size_t size, size_t n);
+    int (*put_array)(QEMUFile *f, void *pv, size_t size, size_t n);
 };
 
 enum VMStateFlags {
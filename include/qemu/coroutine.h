@@ -337,10 +337,21 @@ void coroutine_fn yield_until_fd_readable(int fd);
 void qemu_coroutine_increase_pool_batch_size(unsigned int additional_pool_size);
 
 /**
- * Devcrease coroutine pool size
+ * Decrease coroutine pool size
+ *
+ * Coroutines held in the pool beyond the new size are freed.
  */
 void qemu_coroutine_decrease_pool_batch_size(unsigned int additional_pool_size);
 
+/**
+ * Return the number of coroutines held in the shared pool
+ *
+ * Coroutines cached by each thread are not counted.  While the main loop
+ * runs, the pool is halved every 10 seconds in which no coroutine was
+ * taken from it.
+ */
+unsigned int qemu_coroutine_get_pool_size(void);
+
 #include "qemu/lockable.h"
 
 #endif /* QEMU_COROUTINE_H */
@@ -174,7 +174,10 @@ char *freq_to_str(uint64_t freq_hz);
 #define STR_OR_NULL(str) ((str) ? (str) : "null")
 
 bool buffer_is_zero(const void *buf, size_t len);
+size_t buffer_zero_pages(const void *buf, size_t len, size_t page_size,
+                         unsigned long *bitmap);
 bool test_buffer_is_zero_next_accel(void);
+const char *test_buffer_is_zero_accel_name(void);
 
 /*
  * Implementation of ULEB128 (http://en.wikipedia.org/wiki/LEB128)
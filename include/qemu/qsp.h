@@ -16,12 +16,38 @@ enum QSPSortBy {
     QSP_SORT_BY_AVG_WAIT_TIME,
 };
 
+/* bucket 0 counts waits below 1 us, bucket i waits of [2^(i-1), 2^i) us */
+#define QSP_HIST_BUCKETS 20
+
+typedef struct QSPReportEntry {
+    const void *obj;
+    char *callsite_at;
+    const char *typename;
+    double time_s;
+    double ns_avg;
+    uint64_t n_acqs;
+    uint64_t hist[QSP_HIST_BUCKETS];
+    unsigned int n_objs;
+} QSPReportEntry;
+
+typedef void QSPReportIterFunc(const QSPReportEntry *entry, void *opaque);
+
 void qsp_report(size_t max, enum QSPSortBy sort_by,
                 bool callsite_coalesce);
+void qsp_report_iter(size_t max, enum QSPSortBy sort_by,
+                     bool callsite_coalesce, QSPReportIterFunc *func,
+                     void *opaque);
 
 bool qsp_is_enabled(void);
 void qsp_enable(void);
 void qsp_disable(void);
 void qsp_reset(void);
 
+/*
+ * Profile only every @period-th operation of each thread and, if
+ * @contended_only is true, only lock acquisitions that have to wait.
+ */
+void qsp_set_sampling(unsigned int period, bool contended_only);
+void qsp_get_sampling(unsigned int *period, bool *contended_only);
+
 #endif /* QEMU_QSP_H */
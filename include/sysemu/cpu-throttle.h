@@ -42,6 +42,20 @@ void cpu_throttle_init(void);
  */
 void cpu_throttle_set(int new_throttle_pct);
 
+/**
+ * cpu_throttle_set_vcpu:
+ * @cpu: The vcpu to throttle.
+ * @pct: Percent of sleep time for @cpu, from 0 to the percentage last
+ *       passed to cpu_throttle_set.
+ *
+ * Switches from uniform to per-vcpu throttling.  The percentage given to
+ * cpu_throttle_set still decides the throttle period and is the maximum
+ * for every vcpu; vcpus that are not given a percentage with
+ * cpu_throttle_set_vcpu are not throttled.  Per-vcpu throttling stays in
+ * effect until cpu_throttle_stop is called.
+ */
+void cpu_throttle_set_vcpu(CPUState *cpu, int pct);
+
 /**
  * cpu_throttle_stop:
  *
@@ -37,6 +37,7 @@ struct IOThread {
     int64_t poll_max_ns;
     int64_t poll_grow;
     int64_t poll_shrink;
+    int64_t poll_hit_target;
 
     /* AioContext AIO engine parameters */
     int64_t aio_max_batch;
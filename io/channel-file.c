@@ -26,6 +26,21 @@
 #include "qemu/sockets.h"
 #include "trace.h"
 
+/*
+ * Positioned I/O needs preadv/pwritev from the host, and a file
+ * descriptor that is not a pipe, FIFO or socket.
+ */
+static void qio_channel_file_check_seekable(QIOChannelFile *ioc)
+{
+#ifdef CONFIG_PREADV
+    if (lseek(ioc->fd, 0, SEEK_CUR) != (off_t)-1) {
+        qio_channel_set_feature(QIO_CHANNEL(ioc),
+                                QIO_CHANNEL_FEATURE_SEEKABLE);
+    }
+#endif
+}
+
+
 QIOChannelFile *
 qio_channel_file_new_fd(int fd)
 {
@@ -34,6 +49,7 @@ qio_channel_file_new_fd(int fd)
     ioc = QIO_CHANNEL_FILE(object_new(TYPE_QIO_CHANNEL_FILE));
 
     ioc->fd = fd;
+    qio_channel_file_check_seekable(ioc);
 
     trace_qio_channel_file_new_fd(ioc, fd);
 
@@ -59,6 +75,8 @@ qio_channel_file_new_path(const char *path,
         return NULL;
     }
 
+    qio_channel_file_check_seekable(ioc);
+
     trace_qio_channel_file_new_path(ioc, path, flags, mode, ioc->fd);
 
     return ioc;
@@ -114,6 +132,7 @@ static ssize_t qio_channel_file_writev(QIOChannel *ioc,
                                        size_t niov,
                                        int *fds,
                                        size_t nfds,
+                                       int flags,
                                        Error **errp)
 {
     QIOChannelFile *fioc = QIO_CHANNEL_FILE(ioc);
@@ -169,6 +188,61 @@ static off_t qio_channel_file_seek(QIOChannel *ioc,
 }
 
 
+#ifdef CONFIG_PREADV
+static ssize_t qio_channel_file_preadv(QIOChannel *ioc,
+                                       const struct iovec *iov,
+                                       size_t niov,
+                                       off_t offset,
+                                       Error **errp)
+{
+    QIOChannelFile *fioc = QIO_CHANNEL_FILE(ioc);
+    ssize_t ret;
+
+ retry:
+    ret = preadv(fioc->fd, iov, niov, offset);
+    if (ret < 0) {
+        if (errno == EAGAIN) {
+            return QIO_CHANNEL_ERR_BLOCK;
+        }
+        if (errno == EINTR) {
+            goto retry;
+        }
+
+        error_setg_errno(errp, errno, "Unable to read from file");
+        return -1;
+    }
+
+    return ret;
+}
+
+static ssize_t qio_channel_file_pwritev(QIOChannel *ioc,
+                                        const struct iovec *iov,
+                                        size_t niov,
+                                        off_t offset,
+                                        Error **errp)
+{
+    QIOChannelFile *fioc = QIO_CHANNEL_FILE(ioc);
+    ssize_t ret;
+
+ retry:
+    ret = pwritev(fioc->fd, iov, niov, offset);
+    if (ret < 0) {
+        if (errno == EAGAIN) {
+            return QIO_CHANNEL_ERR_BLOCK;
+        }
+        if (errno == EINTR) {
+            goto retry;
+        }
+
+        error_setg_errno(errp, errno, "Unable to write to file");
+        return -1;
+    }
+
+    return ret;
+}
+#endif /* CONFIG_PREADV */
+
+
 static int qio_channel_file_close(QIOChannel *ioc,
                                   Error **errp)
 {
@@ -213,6 +287,10 @@ static void qio_channel_file_class_init(ObjectClass *klass,
     ioc_klass->io_readv = qio_channel_file_readv;
     ioc_klass->io_set_blocking = qio_channel_file_set_blocking;
     ioc_klass->io_seek = qio_channel_file_seek;
+#ifdef CONFIG_PREADV
+    ioc_klass->io_preadv = qio_channel_file_preadv;
+    ioc_klass->io_pwritev = qio_channel_file_pwritev;
+#endif
     ioc_klass->io_close = qio_channel_file_close;
     ioc_klass->io_create_watch = qio_channel_file_create_watch;
     ioc_klass->io_set_aio_fd_handler = qio_channel_file_set_aio_fd_handler;
@@ -160,6 +160,7 @@ static void iothread_set_aio_context_params(IOThread *iothread, Error **errp)
                                 iothread->poll_max_ns,
                                 iothread->poll_grow,
                                 iothread->poll_shrink,
+                                iothread->poll_hit_target,
                                 errp);
     if (*errp) {
         return;
@@ -215,19 +216,23 @@ static void iothread_complete(UserCreatable *obj, Error **errp)
 typedef struct {
     const char *name;
     ptrdiff_t offset; /* field's byte offset in IOThread struct */
+    int64_t max;
 } IOThreadParamInfo;
 
 static IOThreadParamInfo poll_max_ns_info = {
-    "poll-max-ns", offsetof(IOThread, poll_max_ns),
+    "poll-max-ns", offsetof(IOThread, poll_max_ns), INT64_MAX,
 };
 static IOThreadParamInfo poll_grow_info = {
-    "poll-grow", offsetof(IOThread, poll_grow),
+    "poll-grow", offsetof(IOThread, poll_grow), INT64_MAX,
 };
 static IOThreadParamInfo poll_shrink_info = {
-    "poll-shrink", offsetof(IOThread, poll_shrink),
+    "poll-shrink", offsetof(IOThread, poll_shrink), INT64_MAX,
+};
+static IOThreadParamInfo poll_hit_target_info = {
+    "poll-hit-target", offsetof(IOThread, poll_hit_target), 100,
 };
 static IOThreadParamInfo aio_max_batch_info = {
-    "aio-max-batch", offsetof(IOThread, aio_max_batch),
+    "aio-max-batch", offsetof(IOThread, aio_max_batch), INT64_MAX,
 };
 
 static void iothread_get_param(Object *obj, Visitor *v,
@@ -250,9 +255,9 @@ static bool iothread_set_param(Object *obj, Visitor *v,
         return false;
     }
 
-    if (value < 0) {
+    if (value < 0 || value > info->max) {
         error_setg(errp, "%s value must be in range [0, %" PRId64 "]",
-                   info->name, INT64_MAX);
+                   info->name, info->max);
         return false;
     }
 
@@ -284,6 +289,7 @@ static void iothread_set_poll_param(Object *obj, Visitor *v,
                                     iothread->poll_max_ns,
                                     iothread->poll_grow,
                                     iothread->poll_shrink,
+                                    iothread->poll_hit_target,
                                     errp);
     }
 }
@@ -330,6 +336,10 @@ static void iothread_class_init(ObjectClass *klass, void *class_data)
                               iothread_get_poll_param,
                               iothread_set_poll_param,
                               NULL, &poll_shrink_info);
+    object_class_property_add(klass, "poll-hit-target", "int",
+                              iothread_get_poll_param,
+                              iothread_set_poll_param,
+                              NULL, &poll_hit_target_info);
     object_class_property_add(klass, "aio-max-batch", "int",
                               iothread_get_aio_param,
                               iothread_set_aio_param,
@@ -383,6 +393,12 @@ static int query_one_iothread(Object *object, void *opaque)
     info->poll_max_ns = iothread->poll_max_ns;
     info->poll_grow = iothread->poll_grow;
     info->poll_shrink = iothread->poll_shrink;
+    info->poll_hit_target = iothread->poll_hit_target;
+    if (iothread->ctx) {
+        info->poll_hits = stat64_get(&iothread->ctx->poll_hits);
+        info->poll_misses = stat64_get(&iothread->ctx->poll_misses);
+        info->poll_wasted_ns = stat64_get(&iothread->ctx->poll_wasted_ns);
+    }
     info->aio_max_batch = iothread->aio_max_batch;
 
     QAPI_LIST_APPEND(*tail, info);
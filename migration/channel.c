@@ -85,9 +85,15 @@ void migration_channel_connect(MigrationState *s,
 
                 return;
             }
+        } else if (migrate_zero_copy_send() &&
+                   !qio_channel_has_feature(
+                       ioc, QIO_CHANNEL_FEATURE_WRITE_ZERO_COPY)) {
+            error_setg(&error, "Zero copy send is not supported by the "
+                       "migration channel");
         } else {
             QEMUFile *f = qemu_fopen_channel_output(ioc);
 
+            qemu_file_set_zero_copy(f, migrate_zero_copy_send());
             migration_ioc_register_yank(ioc);
 
             qemu_mutex_lock(&s->qemu_file_lock);
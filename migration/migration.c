@@ -17,6 +17,7 @@
 #include "qemu/cutils.h"
 #include "qemu/error-report.h"
 #include "qemu/main-loop.h"
+#include "qemu/units.h"
 #include "migration/blocker.h"
 #include "exec.h"
 #include "fd.h"
@@ -24,6 +25,7 @@
 #include "sysemu/runstate.h"
 #include "sysemu/sysemu.h"
 #include "sysemu/cpu-throttle.h"
+#include "sysemu/kvm.h"
 #include "rdma.h"
 #include "ram.h"
 #include "migration/global_state.h"
@@ -158,6 +160,7 @@ INITIALIZE_MIGRATE_CAPS_SET(check_caps_background_snapshot,
     MIGRATION_CAPABILITY_MULTIFD,
     MIGRATION_CAPABILITY_PAUSE_BEFORE_SWITCHOVER,
     MIGRATION_CAPABILITY_AUTO_CONVERGE,
+    MIGRATION_CAPABILITY_X_AUTO_CONVERGE_PER_VCPU,
     MIGRATION_CAPABILITY_RELEASE_RAM,
     MIGRATION_CAPABILITY_RDMA_PIN_ALL,
     MIGRATION_CAPABILITY_COMPRESS,
@@ -165,6 +168,37 @@ INITIALIZE_MIGRATE_CAPS_SET(check_caps_background_snapshot,
     MIGRATION_CAPABILITY_X_COLO,
     MIGRATION_CAPABILITY_VALIDATE_UUID);
 
+/* Mapped-ram compatibility check list */
+static const
+INITIALIZE_MIGRATE_CAPS_SET(check_caps_mapped_ram,
+    MIGRATION_CAPABILITY_POSTCOPY_RAM,
+    MIGRATION_CAPABILITY_MULTIFD,
+    MIGRATION_CAPABILITY_RELEASE_RAM,
+    MIGRATION_CAPABILITY_COMPRESS,
+    MIGRATION_CAPABILITY_XBZRLE,
+    MIGRATION_CAPABILITY_X_COLO,
+    MIGRATION_CAPABILITY_BACKGROUND_SNAPSHOT);
+
+/* Page-dedup compatibility check list */
+static const
+INITIALIZE_MIGRATE_CAPS_SET(check_caps_page_dedup,
+    MIGRATION_CAPABILITY_COMPRESS,
+    MIGRATION_CAPABILITY_XBZRLE,
+    MIGRATION_CAPABILITY_MULTIFD,
+    MIGRATION_CAPABILITY_X_COLO,
+    MIGRATION_CAPABILITY_MAPPED_RAM);
+
+#ifdef CONFIG_LINUX
+/* Zero-copy-send compatibility check list */
+static const
+INITIALIZE_MIGRATE_CAPS_SET(check_caps_zero_copy_send,
+    MIGRATION_CAPABILITY_COMPRESS,
+    MIGRATION_CAPABILITY_MULTIFD,
+    MIGRATION_CAPABILITY_RDMA_PIN_ALL,
+    MIGRATION_CAPABILITY_MAPPED_RAM,
+    MIGRATION_CAPABILITY_PAGE_DEDUP);
+#endif
+
 /* When we add fault tolerance, we could have several
    migrations at once.  For now we don't need to add
    dynamic creation of migration */
@@ -180,7 +214,8 @@ static int migration_maybe_pause(MigrationState *s,
                                  int new_state);
 static void migrate_fd_cancel(MigrationState *s);
 
-static gint page_request_addr_cmp(gconstpointer ap, gconstpointer bp)
+static gint page_request_addr_cmp(gconstpointer ap, gconstpointer bp,
+                                  gpointer unused)
 {
     uintptr_t a = (uintptr_t) ap, b = (uintptr_t) bp;
 
@@ -207,7 +242,8 @@ void migration_object_init(void)
     qemu_sem_init(&current_incoming->postcopy_pause_sem_dst, 0);
     qemu_sem_init(&current_incoming->postcopy_pause_sem_fault, 0);
     qemu_mutex_init(&current_incoming->page_request_mutex);
-    current_incoming->page_requested = g_tree_new(page_request_addr_cmp);
+    current_incoming->page_requested =
+        g_tree_new_full(page_request_addr_cmp, NULL, NULL, g_free);
 
     migration_object_check(current_migration, &error_fatal);
 
@@ -409,10 +445,13 @@ int migrate_send_rp_req_pages(MigrationIncomingState *mis,
         if (!received && !g_tree_lookup(mis->page_requested, aligned)) {
             /*
              * The page has not been received, and it's not yet in the page
-             * request list.  Queue it.  Set the value of element to 1, so that
-             * things like g_tree_lookup() will return TRUE (1) when found.
+             * request list.  Queue it, remembering when it was first asked
+             * for so that the fault latency can be accounted on arrival.
              */
-            g_tree_insert(mis->page_requested, aligned, (gpointer)1);
+            int64_t *req_time = g_new(int64_t, 1);
+
+            *req_time = qemu_clock_get_ns(QEMU_CLOCK_REALTIME);
+            g_tree_insert(mis->page_requested, aligned, req_time);
             mis->page_requested_count++;
             trace_postcopy_page_req_add(aligned, mis->page_requested_count);
         }
@@ -1017,6 +1056,7 @@ static void populate_ram_info(MigrationInfo *info, MigrationState *s)
     info->ram->precopy_bytes = ram_counters.precopy_bytes;
     info->ram->downtime_bytes = ram_counters.downtime_bytes;
     info->ram->postcopy_bytes = ram_counters.postcopy_bytes;
+    info->ram->dedup_pages = ram_counters.dedup_pages;
 
     if (migrate_use_xbzrle()) {
         info->has_xbzrle_cache = true;
@@ -1030,7 +1070,7 @@ static void populate_ram_info(MigrationInfo *info, MigrationState *s)
         info->xbzrle_cache->overflow = xbzrle_counters.overflow;
     }
 
-    if (migrate_use_compression()) {
+    if (migrate_use_compression() || migrate_use_multifd_compression()) {
         info->has_compression = true;
         info->compression = g_malloc0(sizeof(*info->compression));
         info->compression->pages = compression_counters.pages;
@@ -1042,6 +1082,15 @@ static void populate_ram_info(MigrationInfo *info, MigrationState *s)
                                     compression_counters.compression_rate;
     }
 
+    if (migrate_use_multifd()) {
+        info->multifd_channels = multifd_send_channel_stats();
+        if (!info->multifd_channels) {
+            info->multifd_channels = QAPI_CLONE(MultiFDChannelStatsList,
+                                                s->multifd_channel_stats);
+        }
+        info->has_multifd_channels = !!info->multifd_channels;
+    }
+
     if (cpu_throttle_active()) {
         info->has_cpu_throttle_percentage = true;
         info->cpu_throttle_percentage = cpu_throttle_get_percentage();
@@ -1253,6 +1302,60 @@ static bool migrate_caps_check(bool *cap_list,
         }
     }
 
+    if (cap_list[MIGRATION_CAPABILITY_X_AUTO_CONVERGE_PER_VCPU]) {
+        if (!cap_list[MIGRATION_CAPABILITY_AUTO_CONVERGE]) {
+            error_setg(errp, "Per-vcpu auto-converge requires the "
+                       "auto-converge capability");
+            return false;
+        }
+        if (!kvm_dirty_ring_enabled()) {
+            error_setg(errp, "Per-vcpu auto-converge requires the KVM "
+                       "dirty ring");
+            return false;
+        }
+    }
+
+    if (cap_list[MIGRATION_CAPABILITY_MAPPED_RAM]) {
+        int idx;
+
+        for (idx = 0; idx < check_caps_mapped_ram.size; idx++) {
+            int incomp_cap = check_caps_mapped_ram.caps[idx];
+            if (cap_list[incomp_cap]) {
+                error_setg(errp, "Mapped-ram is not compatible with %s",
+                           MigrationCapability_str(incomp_cap));
+                return false;
+            }
+        }
+    }
+
+    if (cap_list[MIGRATION_CAPABILITY_PAGE_DEDUP]) {
+        int idx;
+
+        for (idx = 0; idx < check_caps_page_dedup.size; idx++) {
+            int incomp_cap = check_caps_page_dedup.caps[idx];
+            if (cap_list[incomp_cap]) {
+                error_setg(errp, "Page-dedup is not compatible with %s",
+                           MigrationCapability_str(incomp_cap));
+                return false;
+            }
+        }
+    }
+
+#ifdef CONFIG_LINUX
+    if (cap_list[MIGRATION_CAPABILITY_ZERO_COPY_SEND]) {
+        int idx;
+
+        for (idx = 0; idx < check_caps_zero_copy_send.size; idx++) {
+            int incomp_cap = check_caps_zero_copy_send.caps[idx];
+            if (cap_list[incomp_cap]) {
+                error_setg(errp, "Zero-copy-send is not compatible with %s",
+                           MigrationCapability_str(incomp_cap));
+                return false;
+            }
+        }
+    }
+#endif
+
     /* incoming side only */
     if (runstate_check(RUN_STATE_INMIGRATE) &&
         !migrate_multifd_is_allowed() &&
@@ -1281,13 +1384,13 @@ static void fill_destination_migration_info(MigrationInfo *info)
     case MIGRATION_STATUS_CANCELLING:
     case MIGRATION_STATUS_CANCELLED:
     case MIGRATION_STATUS_ACTIVE:
-    case MIGRATION_STATUS_POSTCOPY_ACTIVE:
-    case MIGRATION_STATUS_POSTCOPY_PAUSED:
-    case MIGRATION_STATUS_POSTCOPY_RECOVER:
     case MIGRATION_STATUS_FAILED:
     case MIGRATION_STATUS_COLO:
         info->has_status = true;
         break;
+    case MIGRATION_STATUS_POSTCOPY_ACTIVE:
+    case MIGRATION_STATUS_POSTCOPY_PAUSED:
+    case MIGRATION_STATUS_POSTCOPY_RECOVER:
     case MIGRATION_STATUS_COMPLETED:
         info->has_status = true;
         fill_destination_postcopy_migration_info(info);
@@ -2063,6 +2166,8 @@ void migrate_init(MigrationState *s)
     s->vm_was_running = false;
     s->iteration_initial_bytes = 0;
     s->threshold_size = 0;
+    qapi_free_MultiFDChannelStatsList(s->multifd_channel_stats);
+    s->multifd_channel_stats = NULL;
 }
 
 int migrate_add_blocker_internal(Error *reason, Error **errp)
@@ -2397,6 +2502,16 @@ bool migrate_auto_converge(void)
     return s->enabled_capabilities[MIGRATION_CAPABILITY_AUTO_CONVERGE];
 }
 
+bool migrate_auto_converge_per_vcpu(void)
+{
+    MigrationState *s;
+
+    s = migrate_get_current();
+
+    return s->enabled_capabilities[
+        MIGRATION_CAPABILITY_X_AUTO_CONVERGE_PER_VCPU];
+}
+
 bool migrate_zero_blocks(void)
 {
     MigrationState *s;
@@ -2551,6 +2666,21 @@ int migrate_multifd_zstd_level(void)
     return s->parameters.multifd_zstd_level;
 }
 
+bool migrate_use_multifd_compression(void)
+{
+    return migrate_use_multifd() &&
+           migrate_multifd_compression() != MULTIFD_COMPRESSION_NONE;
+}
+
+bool migrate_multifd_zero_page(void)
+{
+    MigrationState *s;
+
+    s = migrate_get_current();
+
+    return s->multifd_zero_page;
+}
+
 int migrate_use_xbzrle(void)
 {
     MigrationState *s;
@@ -2614,6 +2744,35 @@ bool migrate_background_snapshot(void)
     return s->enabled_capabilities[MIGRATION_CAPABILITY_BACKGROUND_SNAPSHOT];
 }
 
+bool migrate_mapped_ram(void)
+{
+    MigrationState *s;
+
+    s = migrate_get_current();
+
+    return s->enabled_capabilities[MIGRATION_CAPABILITY_MAPPED_RAM];
+}
+
+bool migrate_page_dedup(void)
+{
+    MigrationState *s;
+
+    s = migrate_get_current();
+
+    return s->enabled_capabilities[MIGRATION_CAPABILITY_PAGE_DEDUP];
+}
+
+#ifdef CONFIG_LINUX
+bool migrate_zero_copy_send(void)
+{
+    MigrationState *s;
+
+    s = migrate_get_current();
+
+    return s->enabled_capabilities[MIGRATION_CAPABILITY_ZERO_COPY_SEND];
+}
+#endif
+
 /* migration thread support */
 /*
  * Something bad happened to the RP stream, mark an error
@@ -4150,6 +4309,16 @@ static Property migration_properties[] = {
                       decompress_error_check, true),
     DEFINE_PROP_UINT8("x-clear-bitmap-shift", MigrationState,
                       clear_bitmap_shift, CLEAR_BITMAP_SHIFT_DEFAULT),
+    DEFINE_PROP_BOOL("multifd-zero-page", MigrationState,
+                     multifd_zero_page, true),
+    DEFINE_PROP_UINT8("x-bitmap-sync-threads", MigrationState,
+                      bitmap_sync_threads, 4),
+    DEFINE_PROP_SIZE("x-bitmap-sync-chunk-size", MigrationState,
+                      bitmap_sync_chunk_size, 1 * GiB),
+    DEFINE_PROP_UINT32("x-postcopy-prefetch-max", MigrationState,
+                      postcopy_prefetch_max, 16),
+    DEFINE_PROP_UINT32("x-page-dedup-entries", MigrationState,
+                      page_dedup_entries, 256 * 1024),
 
     /* Migration parameters */
     DEFINE_PROP_UINT8("x-compress-level", MigrationState,
@@ -4231,6 +4400,14 @@ static Property migration_properties[] = {
     DEFINE_PROP_MIG_CAP("x-multifd", MIGRATION_CAPABILITY_MULTIFD),
     DEFINE_PROP_MIG_CAP("x-background-snapshot",
             MIGRATION_CAPABILITY_BACKGROUND_SNAPSHOT),
+    DEFINE_PROP_MIG_CAP("x-auto-converge-per-vcpu",
+            MIGRATION_CAPABILITY_X_AUTO_CONVERGE_PER_VCPU),
+    DEFINE_PROP_MIG_CAP("x-mapped-ram", MIGRATION_CAPABILITY_MAPPED_RAM),
+#ifdef CONFIG_LINUX
+    DEFINE_PROP_MIG_CAP("x-zero-copy-send",
+            MIGRATION_CAPABILITY_ZERO_COPY_SEND),
+#endif
+    DEFINE_PROP_MIG_CAP("x-page-dedup", MIGRATION_CAPABILITY_PAGE_DEDUP),
 
     DEFINE_PROP_END_OF_LIST(),
 };
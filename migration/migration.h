@@ -45,6 +45,12 @@ struct PostcopyBlocktimeContext;
  */
 #define CLEAR_BITMAP_SHIFT_MAX            31
 
+/*
+ * Buckets of the postcopy page request latency histogram; the last one
+ * collects everything from 2^31 us (about 36 minutes) up.
+ */
+#define PAGE_REQUEST_LATENCY_BUCKETS      32
+
 /* State for the incoming migration */
 struct MigrationIncomingState {
     QEMUFile *from_src_file;
@@ -114,6 +120,14 @@ struct MigrationIncomingState {
     GTree *page_requested;
     /* For debugging purpose only, but would be nice to keep */
     int page_requested_count;
+    /*
+     * Requested pages that were placed, their total latency in ns from
+     * the request to the placement, and a histogram of that latency where
+     * bucket i counts latencies in [2^i, 2^(i+1)) us.
+     */
+    uint64_t page_requested_placed;
+    uint64_t page_request_latency;
+    uint64_t page_request_latency_dist[PAGE_REQUEST_LATENCY_BUCKETS];
     /*
      * The mutex helps to maintain the requested pages that we sent to the
      * source, IOW, to guarantee coherent between the page_requests tree and
@@ -292,10 +306,46 @@ struct MigrationState {
      */
     uint8_t clear_bitmap_shift;
 
+    /*
+     * Whether multifd channels detect zero pages themselves and send
+     * them as offsets only.  Left at false for qemu older than 7.0,
+     * whose multifd receive side does not know about zero pages.
+     */
+    bool multifd_zero_page;
+
+    /*
+     * Number of threads, including the migration thread, that sync
+     * the dirty bitmap of large RAMBlocks in parallel.  1 disables it.
+     */
+    uint8_t bitmap_sync_threads;
+    /*
+     * Amount of guest memory handed to one of those threads at a time,
+     * rounded up to what one bit of clear_bmap covers.
+     */
+    uint64_t bitmap_sync_chunk_size;
+
+    /*
+     * Upper bound of the adaptive postcopy prefetch window, counted in
+     * page requests from the destination.  0 disables prefetching.
+     */
+    uint32_t postcopy_prefetch_max;
+
+    /*
+     * Number of recently sent pages remembered by the page-dedup
+     * capability, rounded down to a power of two.
+     */
+    uint32_t page_dedup_entries;
+
     /*
      * This save hostname when out-going migration starts
      */
     char *hostname;
+
+    /*
+     * Counters of the multifd channels, saved when they are torn down
+     * so that query-migrate still has them once the migration ended
+     */
+    MultiFDChannelStatsList *multifd_channel_stats;
 };
 
 void migrate_set_state(int *state, int old_state, int new_state);
@@ -332,12 +382,15 @@ bool migrate_ignore_shared(void);
 bool migrate_validate_uuid(void);
 
 bool migrate_auto_converge(void);
+bool migrate_auto_converge_per_vcpu(void);
 bool migrate_use_multifd(void);
 bool migrate_pause_before_switchover(void);
 int migrate_multifd_channels(void);
 MultiFDCompression migrate_multifd_compression(void);
 int migrate_multifd_zlib_level(void);
 int migrate_multifd_zstd_level(void);
+bool migrate_use_multifd_compression(void);
+bool migrate_multifd_zero_page(void);
 
 int migrate_use_xbzrle(void);
 uint64_t migrate_xbzrle_cache_size(void);
@@ -358,6 +411,13 @@ int migrate_decompress_threads(void);
 bool migrate_use_events(void);
 bool migrate_postcopy_blocktime(void);
 bool migrate_background_snapshot(void);
+bool migrate_mapped_ram(void);
+bool migrate_page_dedup(void);
+#ifdef CONFIG_LINUX
+bool migrate_zero_copy_send(void);
+#else
+#define migrate_zero_copy_send() (false)
+#endif
 
 /* Sending on the return path - generic and then for each message type */
 void migrate_send_rp_shut(MigrationIncomingState *mis,
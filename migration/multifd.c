@@ -12,6 +12,8 @@
 
 #include "qemu/osdep.h"
 #include "qemu/rcu.h"
+#include "qemu/cutils.h"
+#include "qemu/timer.h"
 #include "exec/target_page.h"
 #include "sysemu/sysemu.h"
 #include "exec/ramblock.h"
@@ -265,6 +267,7 @@ static void multifd_send_fill_packet(MultiFDSendParams *p)
     packet->normal_pages = cpu_to_be32(p->normal_num);
     packet->next_packet_size = cpu_to_be32(p->next_packet_size);
     packet->packet_num = cpu_to_be64(p->packet_num);
+    packet->zero_pages = cpu_to_be32(p->zero_num);
 
     if (p->pages->block) {
         strncpy(packet->ramblock, p->pages->block->idstr, 256);
@@ -276,6 +279,12 @@ static void multifd_send_fill_packet(MultiFDSendParams *p)
 
         packet->offset[i] = cpu_to_be64(temp);
     }
+    for (i = 0; i < p->zero_num; i++) {
+        /* there are architectures where ram_addr_t is 32 bit */
+        uint64_t temp = p->zero[i];
+
+        packet->offset[p->normal_num + i] = cpu_to_be64(temp);
+    }
 }
 
 static int multifd_recv_unfill_packet(MultiFDRecvParams *p, Error **errp)
@@ -324,10 +333,18 @@ static int multifd_recv_unfill_packet(MultiFDRecvParams *p, Error **errp)
         return -1;
     }
 
+    p->zero_num = be32_to_cpu(packet->zero_pages);
+    if (p->zero_num > packet->pages_alloc - p->normal_num) {
+        error_setg(errp, "multifd: received packet "
+                   "with %u zero pages and expected maximum pages are %u",
+                   p->zero_num, packet->pages_alloc - p->normal_num) ;
+        return -1;
+    }
+
     p->next_packet_size = be32_to_cpu(packet->next_packet_size);
     p->packet_num = be64_to_cpu(packet->packet_num);
 
-    if (p->normal_num == 0) {
+    if (p->normal_num == 0 && p->zero_num == 0) {
         return 0;
     }
 
@@ -353,6 +370,18 @@ static int multifd_recv_unfill_packet(MultiFDRecvParams *p, Error **errp)
         p->normal[i] = offset;
     }
 
+    for (i = 0; i < p->zero_num; i++) {
+        uint64_t offset = be64_to_cpu(packet->offset[p->normal_num + i]);
+
+        if (offset > (block->used_length - page_size)) {
+            error_setg(errp, "multifd: offset too long %" PRIu64
+                       " (max " RAM_ADDR_FMT ")",
+                       offset, block->used_length);
+            return -1;
+        }
+        p->zero[i] = offset;
+    }
+
     return 0;
 }
 
@@ -392,6 +421,39 @@ struct {
  * false.
  */
 
+/*
+ * The migration thread accounts every queued page as a normal page of
+ * full size.  Move the pages that the channel found to be zero over to
+ * the duplicate counter and the pages it compressed over to
+ * compression_counters, and replace the bytes charged for them with
+ * what was actually sent, both in the statistics and in the rate limit
+ * of @f.
+ * Called from the migration thread with p->mutex held.
+ */
+static void multifd_account_channel(QEMUFile *f, MultiFDSendParams *p)
+{
+    uint64_t page_size = qemu_target_page_size();
+    uint64_t charged, sent;
+
+    ram_counters.duplicate += p->zero_unaccounted;
+    ram_counters.normal -= p->zero_unaccounted;
+    charged = p->zero_unaccounted * page_size;
+    sent = 0;
+
+    compression_counters.pages += p->compressed_pages_unaccounted;
+    compression_counters.compressed_size += p->compressed_bytes_unaccounted;
+    ram_counters.normal -= p->compressed_pages_unaccounted;
+    charged += p->compressed_pages_unaccounted * page_size;
+    sent += p->compressed_bytes_unaccounted;
+
+    ram_counters.multifd_bytes = ram_counters.multifd_bytes - charged + sent;
+    ram_counters.transferred = ram_counters.transferred - charged + sent;
+    qemu_file_update_transfer(f, (int64_t)sent - (int64_t)charged);
+    p->zero_unaccounted = 0;
+    p->compressed_pages_unaccounted = 0;
+    p->compressed_bytes_unaccounted = 0;
+}
+
 static int multifd_send_pages(QEMUFile *f)
 {
     int i;
@@ -430,6 +492,7 @@ static int multifd_send_pages(QEMUFile *f)
     assert(!p->pages->num);
     assert(!p->pages->block);
 
+    multifd_account_channel(f, p);
     p->packet_num = multifd_send_state->packet_num++;
     multifd_send_state->pages = p->pages;
     p->pages = pages;
@@ -513,8 +576,44 @@ static void multifd_send_terminate_threads(Error *err)
     }
 }
 
+/*
+ * Counters of each outgoing channel, for query-migrate; NULL when the
+ * channels are not set up.
+ */
+MultiFDChannelStatsList *multifd_send_channel_stats(void)
+{
+    MultiFDChannelStatsList *head = NULL, **tail = &head;
+    size_t page_size = qemu_target_page_size();
+    int i;
+
+    if (!multifd_send_state) {
+        return NULL;
+    }
+    for (i = 0; i < migrate_multifd_channels(); i++) {
+        MultiFDSendParams *p = &multifd_send_state->params[i];
+        MultiFDChannelStats *stats = g_new0(MultiFDChannelStats, 1);
+
+        qemu_mutex_lock(&p->mutex);
+        stats->id = p->id;
+        stats->packets = p->num_packets;
+        stats->normal_pages = p->total_normal_pages;
+        stats->zero_pages = p->total_zero_pages;
+        stats->compressed_size = p->total_compressed_bytes;
+        stats->prepare_time = p->total_prepare_ns;
+        qemu_mutex_unlock(&p->mutex);
+
+        if (stats->compressed_size) {
+            stats->compression_rate = (double)stats->normal_pages *
+                                      page_size / stats->compressed_size;
+        }
+        QAPI_LIST_APPEND(tail, stats);
+    }
+    return head;
+}
+
 void multifd_save_cleanup(void)
 {
+    MigrationState *s = migrate_get_current();
     int i;
 
     if (!migrate_use_multifd() || !migrate_multifd_is_allowed()) {
@@ -528,6 +627,8 @@ void multifd_save_cleanup(void)
             qemu_thread_join(&p->thread);
         }
     }
+    qapi_free_MultiFDChannelStatsList(s->multifd_channel_stats);
+    s->multifd_channel_stats = multifd_send_channel_stats();
     for (i = 0; i < migrate_multifd_channels(); i++) {
         MultiFDSendParams *p = &multifd_send_state->params[i];
         Error *local_err = NULL;
@@ -553,6 +654,8 @@ void multifd_save_cleanup(void)
         p->iov = NULL;
         g_free(p->normal);
         p->normal = NULL;
+        g_free(p->zero);
+        p->zero = NULL;
         multifd_send_state->ops->send_cleanup(p, &local_err);
         if (local_err) {
             migrate_set_error(migrate_get_current(), local_err);
@@ -594,6 +697,7 @@ void multifd_send_sync_main(QEMUFile *f)
             return;
         }
 
+        multifd_account_channel(f, p);
         p->packet_num = multifd_send_state->packet_num++;
         p->flags |= MULTIFD_FLAG_SYNC;
         p->pending_job++;
@@ -608,6 +712,10 @@ void multifd_send_sync_main(QEMUFile *f)
 
         trace_multifd_send_sync_main_wait(p->id);
         qemu_sem_wait(&p->sem_sync);
+
+        qemu_mutex_lock(&p->mutex);
+        multifd_account_channel(f, p);
+        qemu_mutex_unlock(&p->mutex);
     }
     trace_multifd_send_sync_main(multifd_send_state->packet_num);
 }
@@ -639,31 +747,54 @@ static void *multifd_send_thread(void *opaque)
         if (p->pending_job) {
             uint64_t packet_num = p->packet_num;
             uint32_t flags = p->flags;
+            bool zero_page = migrate_multifd_zero_page();
             p->iovs_num = 1;
             p->normal_num = 0;
+            p->zero_num = 0;
+            p->next_packet_size = 0;
 
             for (int i = 0; i < p->pages->num; i++) {
-                p->normal[p->normal_num] = p->pages->offset[i];
-                p->normal_num++;
+                ram_addr_t offset = p->pages->offset[i];
+
+                if (zero_page &&
+                    buffer_is_zero(p->pages->block->host + offset,
+                                   qemu_target_page_size())) {
+                    p->zero[p->zero_num] = offset;
+                    p->zero_num++;
+                } else {
+                    p->normal[p->normal_num] = offset;
+                    p->normal_num++;
+                }
             }
 
             if (p->normal_num) {
+                int64_t start = qemu_clock_get_ns(QEMU_CLOCK_REALTIME);
+
                 ret = multifd_send_state->ops->send_prepare(p, &local_err);
                 if (ret != 0) {
                     qemu_mutex_unlock(&p->mutex);
                     break;
                 }
+                p->total_prepare_ns +=
+                    qemu_clock_get_ns(QEMU_CLOCK_REALTIME) - start;
+                if (migrate_use_multifd_compression()) {
+                    p->total_compressed_bytes += p->next_packet_size;
+                    p->compressed_pages_unaccounted += p->normal_num;
+                    p->compressed_bytes_unaccounted += p->next_packet_size;
+                }
             }
             multifd_send_fill_packet(p);
             p->flags = 0;
             p->num_packets++;
             p->total_normal_pages += p->normal_num;
+            p->total_zero_pages += p->zero_num;
+            p->zero_unaccounted += p->zero_num;
             p->pages->num = 0;
             p->pages->block = NULL;
             qemu_mutex_unlock(&p->mutex);
 
-            trace_multifd_send(p->id, packet_num, p->normal_num, flags,
-                               p->next_packet_size);
+            trace_multifd_send(p->id, packet_num, p->normal_num, p->zero_num,
+                               flags, p->next_packet_size);
 
             p->iov[0].iov_len = p->packet_len;
             p->iov[0].iov_base = p->packet;
@@ -712,7 +843,10 @@ out:
     qemu_mutex_unlock(&p->mutex);
 
     rcu_unregister_thread();
-    trace_multifd_send_thread_end(p->id, p->num_packets, p->total_normal_pages);
+    trace_multifd_send_thread_end(p->id, p->num_packets, p->total_normal_pages,
+                                  p->total_zero_pages,
+                                  p->total_compressed_bytes,
+                                  p->total_prepare_ns);
 
     return NULL;
 }
@@ -913,6 +1047,7 @@ int multifd_save_setup(Error **errp)
         /* We need one extra place for the packet header */
         p->iov = g_new0(struct iovec, page_count + 1);
         p->normal = g_new0(ram_addr_t, page_count);
+        p->zero = g_new0(ram_addr_t, page_count);
         socket_send_channel_create(multifd_new_send_channel_async, p);
     }
 
@@ -1014,6 +1149,8 @@ int multifd_load_cleanup(Error **errp)
         p->iov = NULL;
         g_free(p->normal);
         p->normal = NULL;
+        g_free(p->zero);
+        p->zero = NULL;
         multifd_recv_state->ops->recv_cleanup(p);
     }
     qemu_sem_destroy(&multifd_recv_state->sem_sync);
@@ -1087,10 +1224,11 @@ static void *multifd_recv_thread(void *opaque)
         flags = p->flags;
         /* recv methods don't know how to handle the SYNC flag */
         p->flags &= ~MULTIFD_FLAG_SYNC;
-        trace_multifd_recv(p->id, p->packet_num, p->normal_num, flags,
-                           p->next_packet_size);
+        trace_multifd_recv(p->id, p->packet_num, p->normal_num, p->zero_num,
+                           flags, p->next_packet_size);
         p->num_packets++;
         p->total_normal_pages += p->normal_num;
+        p->total_zero_pages += p->zero_num;
         qemu_mutex_unlock(&p->mutex);
 
         if (p->normal_num) {
@@ -1100,6 +1238,12 @@ static void *multifd_recv_thread(void *opaque)
             }
         }
 
+        /* only write to pages that are not already zero */
+        for (int i = 0; i < p->zero_num; i++) {
+            ram_handle_compressed(p->host + p->zero[i], 0,
+                                  qemu_target_page_size());
+        }
+
         if (flags & MULTIFD_FLAG_SYNC) {
             qemu_sem_post(&multifd_recv_state->sem_sync);
             qemu_sem_wait(&p->sem_sync);
@@ -1115,7 +1259,8 @@ static void *multifd_recv_thread(void *opaque)
     qemu_mutex_unlock(&p->mutex);
 
     rcu_unregister_thread();
-    trace_multifd_recv_thread_end(p->id, p->num_packets, p->total_normal_pages);
+    trace_multifd_recv_thread_end(p->id, p->num_packets, p->total_normal_pages,
+                                  p->total_zero_pages);
 
     return NULL;
 }
@@ -1153,6 +1298,7 @@ int multifd_load_setup(Error **errp)
         p->name = g_strdup_printf("multifdrecv_%d", i);
         p->iov = g_new0(struct iovec, page_count);
         p->normal = g_new0(ram_addr_t, page_count);
+        p->zero = g_new0(ram_addr_t, page_count);
     }
 
     for (i = 0; i < thread_count; i++) {
@@ -23,6 +23,7 @@ bool multifd_recv_all_channels_created(void);
 bool multifd_recv_new_channel(QIOChannel *ioc, Error **errp);
 void multifd_recv_sync_main(void);
 void multifd_send_sync_main(QEMUFile *f);
+MultiFDChannelStatsList *multifd_send_channel_stats(void);
 int multifd_queue_page(QEMUFile *f, RAMBlock *block, ram_addr_t offset);
 
 /* Multifd Compression flags */
@@ -49,8 +50,12 @@ typedef struct {
     /* size of the next packet that contains pages */
     uint32_t next_packet_size;
     uint64_t packet_num;
-    uint64_t unused[4];    /* Reserved for future use */
+    /* zero pages */
+    uint32_t zero_pages;
+    uint32_t unused32[1];    /* Reserved for future use */
+    uint64_t unused64[3];    /* Reserved for future use */
     char ramblock[256];
+    /* normal pages followed by zero pages */
     uint64_t offset[];
 } __attribute__((packed)) MultiFDPacket_t;
 
@@ -107,6 +112,18 @@ typedef struct {
     uint64_t num_packets;
     /* non zero pages sent through this channel */
     uint64_t total_normal_pages;
+    /* zero pages sent through this channel */
+    uint64_t total_zero_pages;
+    /* compressed size of the pages sent through this channel */
+    uint64_t total_compressed_bytes;
+    /* time spent in send_prepare() by this channel */
+    uint64_t total_prepare_ns;
+    /* zero pages not yet folded into ram_counters */
+    uint64_t zero_unaccounted;
+    /* compressed pages not yet folded into compression_counters */
+    uint64_t compressed_pages_unaccounted;
+    /* compressed size of those pages */
+    uint64_t compressed_bytes_unaccounted;
     /* syncs main thread and channels */
     QemuSemaphore sem_sync;
     /* buffers to send */
@@ -117,6 +134,10 @@ typedef struct {
     ram_addr_t *normal;
     /* num of non zero pages */
     uint32_t normal_num;
+    /* Pages that are zero */
+    ram_addr_t *zero;
+    /* num of zero pages */
+    uint32_t zero_num;
     /* used for compression methods */
     void *data;
 }  MultiFDSendParams;
@@ -154,6 +175,8 @@ typedef struct {
     uint64_t num_packets;
     /* non zero pages recv through this channel */
     uint64_t total_normal_pages;
+    /* zero pages recv through this channel */
+    uint64_t total_zero_pages;
     /* syncs main thread and channels */
     QemuSemaphore sem_sync;
     /* buffers to recv */
@@ -162,6 +185,10 @@ typedef struct {
     ram_addr_t *normal;
     /* num of non zero pages */
     uint32_t normal_num;
+    /* Pages that are zero */
+    ram_addr_t *zero;
+    /* num of zero pages */
+    uint32_t zero_num;
     /* used for de-compression methods */
     void *data;
 } MultiFDRecvParams;
@@ -19,6 +19,7 @@
 #include "qemu/osdep.h"
 #include "qemu/rcu.h"
 #include "qemu/madvise.h"
+#include "qemu/host-utils.h"
 #include "exec/target_page.h"
 #include "migration.h"
 #include "qemu-file.h"
@@ -159,9 +160,37 @@ static uint32List *get_vcpu_blocktime_list(PostcopyBlocktimeContext *ctx)
 }
 
 /*
- * This function just populates MigrationInfo from postcopy's
- * blocktime context. It will not populate MigrationInfo,
- * unless postcopy-blocktime capability was set.
+ * Account the time between the request of a page to the source and its
+ * placement.  Called with page_request_mutex held.
+ */
+static void postcopy_account_request_latency(MigrationIncomingState *mis,
+                                             int64_t latency_ns)
+{
+    uint64_t latency_us = MAX(latency_ns, 0) / SCALE_US;
+    int bucket = latency_us ? 63 - clz64(latency_us) : 0;
+
+    mis->page_requested_placed++;
+    mis->page_request_latency += MAX(latency_ns, 0);
+    mis->page_request_latency_dist[MIN(bucket,
+                                       PAGE_REQUEST_LATENCY_BUCKETS - 1)]++;
+}
+
+static uint64List *get_request_latency_dist(MigrationIncomingState *mis)
+{
+    uint64List *list = NULL;
+    int i;
+
+    for (i = PAGE_REQUEST_LATENCY_BUCKETS - 1; i >= 0; i--) {
+        QAPI_LIST_PREPEND(list, mis->page_request_latency_dist[i]);
+    }
+
+    return list;
+}
+
+/*
+ * This function just populates MigrationInfo from postcopy's page
+ * request latency statistics and blocktime context. The blocktime
+ * is not populated unless postcopy-blocktime capability was set.
  *
  * @info: pointer to MigrationInfo to populate
  */
@@ -170,6 +199,16 @@ void fill_destination_postcopy_migration_info(MigrationInfo *info)
     MigrationIncomingState *mis = migration_incoming_get_current();
     PostcopyBlocktimeContext *bc = mis->blocktime_ctx;
 
+    WITH_QEMU_LOCK_GUARD(&mis->page_request_mutex) {
+        if (mis->page_requested_placed) {
+            info->has_postcopy_latency = true;
+            info->postcopy_latency =
+                mis->page_request_latency / mis->page_requested_placed;
+            info->has_postcopy_latency_dist = true;
+            info->postcopy_latency_dist = get_request_latency_dist(mis);
+        }
+    }
+
     if (!bc) {
         return;
     }
@@ -1178,6 +1217,7 @@ static int qemu_ufd_copy_ioctl(MigrationIncomingState *mis, void *host_addr,
                                void *from_addr, uint64_t pagesize, RAMBlock *rb)
 {
     int userfault_fd = mis->userfault_fd;
+    int64_t *req_time;
     int ret;
 
     if (from_addr) {
@@ -1202,7 +1242,10 @@ static int qemu_ufd_copy_ioctl(MigrationIncomingState *mis, void *host_addr,
          * If this page resolves a page fault for a previous recorded faulted
          * address, take a special note to maintain the requested page list.
          */
-        if (g_tree_lookup(mis->page_requested, host_addr)) {
+        req_time = g_tree_lookup(mis->page_requested, host_addr);
+        if (req_time) {
+            postcopy_account_request_latency(mis, qemu_clock_get_ns(
+                QEMU_CLOCK_REALTIME) - *req_time);
             g_tree_remove(mis->page_requested, host_addr);
             mis->page_requested_count--;
             trace_postcopy_page_req_del(host_addr, mis->page_requested_count);
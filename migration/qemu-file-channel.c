@@ -25,8 +25,10 @@
 #include "qemu/osdep.h"
 #include "qemu-file-channel.h"
 #include "qemu-file.h"
+#include "io/channel-file.h"
 #include "io/channel-socket.h"
 #include "io/channel-tls.h"
+#include "qapi/error.h"
 #include "qemu/iov.h"
 #include "qemu/yank.h"
 #include "yank_functions.h"
@@ -36,6 +38,7 @@ static ssize_t channel_writev_buffer(void *opaque,
                                      struct iovec *iov,
                                      int iovcnt,
                                      int64_t pos,
+                                     int flags,
                                      Error **errp)
 {
     QIOChannel *ioc = QIO_CHANNEL(opaque);
@@ -50,7 +53,8 @@ static ssize_t channel_writev_buffer(void *opaque,
 
     while (nlocal_iov > 0) {
         ssize_t len;
-        len = qio_channel_writev(ioc, local_iov, nlocal_iov, errp);
+        len = qio_channel_writev_full(ioc, local_iov, nlocal_iov,
+                                      NULL, 0, flags, errp);
         if (len == QIO_CHANNEL_ERR_BLOCK) {
             if (qemu_in_coroutine()) {
                 qio_channel_yield(ioc, G_IO_OUT);
@@ -73,6 +77,16 @@ static ssize_t channel_writev_buffer(void *opaque,
     return done;
 }
 
+static int channel_writev_flush(void *opaque, Error **errp)
+{
+    QIOChannel *ioc = QIO_CHANNEL(opaque);
+
+    if (qio_channel_flush(ioc, errp) < 0) {
+        return -EIO;
+    }
+    return 0;
+}
+
 
 static ssize_t channel_get_buffer(void *opaque,
                                   uint8_t *buf,
@@ -149,6 +163,104 @@ static int channel_set_blocking(void *opaque,
     return 0;
 }
 
+/*
+ * Only regular files give meaningful random access; pipes and sockets,
+ * even when wrapped in a QIOChannelFile, lack QIO_CHANNEL_FEATURE_SEEKABLE.
+ */
+static bool channel_is_seekable(QIOChannel *ioc, Error **errp)
+{
+    if (!object_dynamic_cast(OBJECT(ioc), TYPE_QIO_CHANNEL_FILE) ||
+        !qio_channel_has_feature(ioc, QIO_CHANNEL_FEATURE_SEEKABLE)) {
+        error_setg(errp, "Migration channel is not seekable");
+        return false;
+    }
+    return true;
+}
+
+static off_t channel_seek(void *opaque,
+                          off_t offset,
+                          int whence,
+                          Error **errp)
+{
+    QIOChannel *ioc = QIO_CHANNEL(opaque);
+    off_t ret;
+
+    ret = qio_channel_io_seek(ioc, offset, whence, errp);
+    return ret < 0 ? -EIO : ret;
+}
+
+
+static ssize_t channel_pread_buffer(void *opaque,
+                                    uint8_t *buf,
+                                    size_t size,
+                                    off_t pos,
+                                    Error **errp)
+{
+    QIOChannel *ioc = QIO_CHANNEL(opaque);
+    size_t done = 0;
+
+    if (!channel_is_seekable(ioc, errp)) {
+        return -ESPIPE;
+    }
+
+    while (done < size) {
+        ssize_t len = qio_channel_pread(ioc, (char *)buf + done, size - done,
+                                        pos + done, errp);
+
+        if (len == QIO_CHANNEL_ERR_BLOCK) {
+            if (qemu_in_coroutine()) {
+                qio_channel_yield(ioc, G_IO_IN);
+            } else {
+                qio_channel_wait(ioc, G_IO_IN);
+            }
+            continue;
+        }
+        if (len < 0) {
+            return -EIO;
+        }
+        if (len == 0) {
+            error_setg(errp, "Unexpected end of file");
+            return -EIO;
+        }
+        done += len;
+    }
+    return done;
+}
+
+
+static ssize_t channel_pwrite_buffer(void *opaque,
+                                     const uint8_t *buf,
+                                     size_t size,
+                                     off_t pos,
+                                     Error **errp)
+{
+    QIOChannel *ioc = QIO_CHANNEL(opaque);
+    size_t done = 0;
+
+    if (!channel_is_seekable(ioc, errp)) {
+        return -ESPIPE;
+    }
+
+    while (done < size) {
+        ssize_t len = qio_channel_pwrite(ioc, (const char *)buf + done,
+                                         size - done, pos + done, errp);
+
+        if (len == QIO_CHANNEL_ERR_BLOCK) {
+            if (qemu_in_coroutine()) {
+                qio_channel_yield(ioc, G_IO_OUT);
+            } else {
+                qio_channel_wait(ioc, G_IO_OUT);
+            }
+            continue;
+        }
+        if (len < 0) {
+            return -EIO;
+        }
+        done += len;
+    }
+    return done;
+}
+
 static QEMUFile *channel_get_input_return_path(void *opaque)
 {
     QIOChannel *ioc = QIO_CHANNEL(opaque);
@@ -169,15 +281,22 @@ static const QEMUFileOps channel_input_ops = {
     .shut_down = channel_shutdown,
     .set_blocking = channel_set_blocking,
     .get_return_path = channel_get_input_return_path,
+    .seek = channel_seek,
+    .pread_buffer = channel_pread_buffer,
+    .pwrite_buffer = channel_pwrite_buffer,
 };
 
 
 static const QEMUFileOps channel_output_ops = {
     .writev_buffer = channel_writev_buffer,
+    .writev_flush = channel_writev_flush,
     .close = channel_close,
     .shut_down = channel_shutdown,
     .set_blocking = channel_set_blocking,
     .get_return_path = channel_get_output_return_path,
+    .seek = channel_seek,
+    .pread_buffer = channel_pread_buffer,
+    .pwrite_buffer = channel_pwrite_buffer,
 };
 
 
@@ -32,7 +32,7 @@
 #include "qapi/error.h"
 
 #define IO_BUF_SIZE 32768
-#define MAX_IOV_SIZE MIN_CONST(IOV_MAX, 64)
+#define MAX_IOV_SIZE MIN_CONST(IOV_MAX, 256)
 
 struct QEMUFile {
     const QEMUFileOps *ops;
@@ -46,7 +46,8 @@ struct QEMUFile {
                     when reading */
     int buf_index;
     int buf_size; /* 0 when writing */
-    uint8_t buf[IO_BUF_SIZE];
+    uint8_t *buf; /* bufs[0], or either of them with zero copy */
+    uint8_t bufs[2][IO_BUF_SIZE];
 
     DECLARE_BITMAP(may_free, MAX_IOV_SIZE);
     struct iovec iov[MAX_IOV_SIZE];
@@ -58,6 +59,10 @@ struct QEMUFile {
     bool shutdown;
     /* Whether opaque points to a QIOChannel */
     bool has_ioc;
+    /* Send with QIO_CHANNEL_WRITE_FLAG_ZERO_COPY, see qemu_fflush() */
+    bool zero_copy;
+    /* The buffer that is not f->buf has not been released by the transport */
+    bool zero_copy_pending;
 };
 
 /*
@@ -113,6 +118,7 @@ QEMUFile *qemu_fopen_ops(void *opaque, const QEMUFileOps *ops, bool has_ioc)
     f->opaque = opaque;
     f->ops = ops;
     f->has_ioc = has_ioc;
+    f->buf = f->bufs[0];
     return f;
 }
 
@@ -212,6 +218,20 @@ static void qemu_iovec_release_ram(QEMUFile *f)
     memset(f->may_free, 0, sizeof(f->may_free));
 }
 
+/*
+ * Wait for the transport to be done with what was last sent zero copy
+ *
+ * Returns 0 on success, -EIO on error
+ */
+static int qemu_file_zero_copy_wait(QEMUFile *f, Error **errp)
+{
+    if (!f->zero_copy_pending) {
+        return 0;
+    }
+    f->zero_copy_pending = false;
+    return f->ops->writev_flush(f->opaque, errp) < 0 ? -EIO : 0;
+}
+
 /**
  * Flushes QEMUFile buffer
  *
@@ -232,9 +252,31 @@ void qemu_fflush(QEMUFile *f)
         return;
     }
     if (f->iovcnt > 0) {
+        int flags = f->zero_copy ? QIO_CHANNEL_WRITE_FLAG_ZERO_COPY : 0;
+
         expect = iov_size(f->iov, f->iovcnt);
-        ret = f->ops->writev_buffer(f->opaque, f->iov, f->iovcnt, f->pos,
-                                    &local_error);
+
+        /*
+         * With zero copy the transport still references f->buf and the
+         * guest pages in f->iov once writev_buffer returns.  Fill the
+         * other buffer meanwhile, and only wait for the transport when
+         * switching back to a buffer it may still be sending from.  The
+         * wait comes before the next send so that it does not cover it.
+         */
+        ret = qemu_file_zero_copy_wait(f, &local_error);
+        if (ret == 0) {
+            ret = f->ops->writev_buffer(f->opaque, f->iov, f->iovcnt, f->pos,
+                                        flags, &local_error);
+        }
+        if (ret == expect && f->zero_copy) {
+            f->zero_copy_pending = true;
+            f->buf = f->buf == f->bufs[0] ? f->bufs[1] : f->bufs[0];
+            /* Pages must not be discarded while they are being sent */
+            if (!bitmap_empty(f->may_free, MAX_IOV_SIZE) &&
+                qemu_file_zero_copy_wait(f, &local_error) < 0) {
+                ret = -EIO;
+            }
+        }
 
         qemu_iovec_release_ram(f);
     }
@@ -252,6 +294,17 @@ void qemu_fflush(QEMUFile *f)
     f->iovcnt = 0;
 }
 
+/*
+ * Send the pages queued with qemu_put_buffer_async() straight from guest
+ * memory instead of letting the transport copy them.  Only valid for
+ * output files whose channel has QIO_CHANNEL_FEATURE_WRITE_ZERO_COPY.
+ */
+void qemu_file_set_zero_copy(QEMUFile *f, bool enable)
+{
+    assert(!enable || f->ops->writev_flush);
+    f->zero_copy = enable;
+}
+
 void ram_control_before_iterate(QEMUFile *f, uint64_t flags)
 {
     int ret = 0;
@@ -381,7 +434,13 @@ void qemu_update_position(QEMUFile *f, size_t size)
 int qemu_fclose(QEMUFile *f)
 {
     int ret;
+    Error *local_error = NULL;
+
     qemu_fflush(f);
+    /* f->bufs go away with f */
+    if (qemu_file_zero_copy_wait(f, &local_error) < 0) {
+        qemu_file_set_error_obj(f, -EIO, local_error);
+    }
     ret = qemu_file_get_error(f);
 
     if (f->ops->close) {
@@ -618,6 +677,113 @@ size_t qemu_get_buffer_in_place(QEMUFile *f, uint8_t **buf, size_t size)
     return qemu_get_buffer(f, *buf, size);
 }
 
+/*
+ * Whether the transport behind @f supports random access, i.e. whether
+ * the positioned helpers below can be used on it.  Some transports can
+ * only be repositioned with qemu_set_offset(), so probe with an empty
+ * positioned read too.
+ */
+bool qemu_file_is_seekable(QEMUFile *f)
+{
+    if (!f->ops->seek || !f->ops->pread_buffer || !f->ops->pwrite_buffer) {
+        return false;
+    }
+    return f->ops->pread_buffer(f->opaque, NULL, 0, 0, NULL) == 0 &&
+           f->ops->seek(f->opaque, 0, SEEK_CUR, NULL) >= 0;
+}
+
+/*
+ * Returns the offset in the underlying transport at which the next
+ * byte of the stream will be read or written, or -1 on error.
+ */
+off_t qemu_get_offset(QEMUFile *f)
+{
+    Error *local_error = NULL;
+    off_t off;
+
+    qemu_fflush(f);
+    if (qemu_file_get_error(f)) {
+        return -1;
+    }
+
+    off = f->ops->seek(f->opaque, 0, SEEK_CUR, &local_error);
+    if (off < 0) {
+        qemu_file_set_error_obj(f, off, local_error);
+        return -1;
+    }
+    /* Data that was read ahead but not consumed yet */
+    return off - (f->buf_size - f->buf_index);
+}
+
+/*
+ * Moves the stream to the absolute offset @off of the underlying
+ * transport; pending writes are flushed and read-ahead data dropped.
+ */
+void qemu_set_offset(QEMUFile *f, off_t off)
+{
+    Error *local_error = NULL;
+    off_t ret;
+
+    qemu_fflush(f);
+    if (qemu_file_get_error(f)) {
+        return;
+    }
+
+    f->buf_index = 0;
+    f->buf_size = 0;
+    ret = f->ops->seek(f->opaque, off, SEEK_SET, &local_error);
+    if (ret < 0) {
+        qemu_file_set_error_obj(f, ret, local_error);
+    }
+}
+
+/*
+ * Writes @size bytes of @buf at the absolute offset @pos of the
+ * underlying transport, outside of the stream.  Errors are latched in
+ * the QEMUFile like for the stream writes.
+ */
+void qemu_put_buffer_at(QEMUFile *f, const uint8_t *buf, size_t size,
+                        off_t pos)
+{
+    Error *local_error = NULL;
+    ssize_t ret;
+
+    if (qemu_file_get_error(f)) {
+        return;
+    }
+
+    ret = f->ops->pwrite_buffer(f->opaque, buf, size, pos, &local_error);
+    if (ret < 0) {
+        qemu_file_set_error_obj(f, ret, local_error);
+        return;
+    }
+    qemu_file_update_transfer(f, size);
+}
+
+/*
+ * Reads @size bytes at the absolute offset @pos of the underlying
+ * transport into @buf, outside of the stream.
+ *
+ * Returns the number of bytes read; on error 0 is returned and the
+ * error latched in the QEMUFile.
+ */
+size_t qemu_get_buffer_at(QEMUFile *f, uint8_t *buf, size_t size, off_t pos)
+{
+    Error *local_error = NULL;
+    ssize_t ret;
+
+    if (qemu_file_get_error(f)) {
+        return 0;
+    }
+
+    ret = f->ops->pread_buffer(f->opaque, buf, size, pos, &local_error);
+    if (ret < 0) {
+        qemu_file_set_error_obj(f, ret, local_error);
+        return 0;
+    }
+    return ret;
+}
+
 /*
  * Peeks a single byte from the buffer; this isn't guaranteed to work if
  * offset leaves a gap after the previous read/peeked data.
@@ -56,11 +56,20 @@ typedef int (QEMUFileSetBlocking)(void *opaque, bool enabled, Error **errp);
 
 /*
  * This function writes an iovec to file. The handler must write all
- * of the data or return a negative errno value.
+ * of the data or return a negative errno value.  @flags is a mask of
+ * QIO_CHANNEL_WRITE_FLAG_* values; backends that cannot honour them
+ * write normally.
  */
 typedef ssize_t (QEMUFileWritevBufferFunc)(void *opaque, struct iovec *iov,
                                            int iovcnt, int64_t pos,
-                                           Error **errp);
+                                           int flags, Error **errp);
+
+/*
+ * Wait until all the memory passed to earlier zero copy writes is no
+ * longer referenced by the transport.  Returns 0 on success or a
+ * negative errno value.
+ */
+typedef int (QEMUFileWritevFlushFunc)(void *opaque, Error **errp);
 
 /*
  * This function provides hooks around different
@@ -104,13 +113,35 @@ typedef QEMUFile *(QEMURetPathFunc)(void *opaque);
 typedef int (QEMUFileShutdownFunc)(void *opaque, bool rd, bool wr,
                                    Error **errp);
 
+/*
+ * Reposition the underlying transport, as lseek(2).  Only implemented
+ * by backends that are seekable; returns the new offset or -errno.
+ */
+typedef off_t (QEMUFileSeekFunc)(void *opaque, off_t offset, int whence,
+                                 Error **errp);
+
+/*
+ * Read or write a buffer at an absolute offset of the underlying
+ * transport without moving the stream position, as pread(2)/pwrite(2).
+ * The handler must transfer all of the data or return a negative errno
+ * value.
+ */
+typedef ssize_t (QEMUFilePreadFunc)(void *opaque, uint8_t *buf, size_t size,
+                                    off_t pos, Error **errp);
+typedef ssize_t (QEMUFilePwriteFunc)(void *opaque, const uint8_t *buf,
+                                     size_t size, off_t pos, Error **errp);
+
 typedef struct QEMUFileOps {
     QEMUFileGetBufferFunc *get_buffer;
     QEMUFileCloseFunc *close;
     QEMUFileSetBlocking *set_blocking;
     QEMUFileWritevBufferFunc *writev_buffer;
+    QEMUFileWritevFlushFunc *writev_flush;
     QEMURetPathFunc *get_return_path;
     QEMUFileShutdownFunc *shut_down;
+    QEMUFileSeekFunc *seek;
+    QEMUFilePreadFunc *pread_buffer;
+    QEMUFilePwriteFunc *pwrite_buffer;
 } QEMUFileOps;
 
 typedef struct QEMUFileHooks {
@@ -139,6 +170,12 @@ bool qemu_file_is_writable(QEMUFile *f);
 
 size_t qemu_peek_buffer(QEMUFile *f, uint8_t **buf, size_t size, size_t offset);
 size_t qemu_get_buffer_in_place(QEMUFile *f, uint8_t **buf, size_t size);
+bool qemu_file_is_seekable(QEMUFile *f);
+off_t qemu_get_offset(QEMUFile *f);
+void qemu_set_offset(QEMUFile *f, off_t off);
+void qemu_put_buffer_at(QEMUFile *f, const uint8_t *buf, size_t size,
+                        off_t pos);
+size_t qemu_get_buffer_at(QEMUFile *f, uint8_t *buf, size_t size, off_t pos);
 ssize_t qemu_put_compression_data(QEMUFile *f, z_stream *stream,
                                   const uint8_t *p, size_t size);
 int qemu_put_qemu_file(QEMUFile *f_des, QEMUFile *f_src);
@@ -161,6 +198,7 @@ void qemu_file_set_error(QEMUFile *f, int ret);
 int qemu_file_shutdown(QEMUFile *f);
 QEMUFile *qemu_file_get_return_path(QEMUFile *f);
 void qemu_fflush(QEMUFile *f);
+void qemu_file_set_zero_copy(QEMUFile *f, bool enable);
 void qemu_file_set_blocking(QEMUFile *f, bool block);
 
 void ram_control_before_iterate(QEMUFile *f, uint64_t flags);
@@ -28,10 +28,12 @@
 
 #include "qemu/osdep.h"
 #include "qemu/cutils.h"
+#include "qemu/units.h"
 #include "qemu/bitops.h"
 #include "qemu/bitmap.h"
 #include "qemu/madvise.h"
 #include "qemu/main-loop.h"
+#include "qemu/xxhash.h"
 #include "xbzrle.h"
 #include "ram.h"
 #include "migration.h"
@@ -58,6 +60,7 @@
 #include "sysemu/runstate.h"
 
 #include "hw/boards.h" /* for machine_dump_guest_core() */
+#include "hw/core/cpu.h"
 
 #if defined(__linux__)
 #include "qemu/userfaultfd.h"
@@ -81,6 +84,25 @@
 #define RAM_SAVE_FLAG_XBZRLE   0x40
 /* 0x80 is reserved in migration.h start with 0x100 next */
 #define RAM_SAVE_FLAG_COMPRESS_PAGE    0x100
+#define RAM_SAVE_FLAG_DEDUP            0x200
+
+/*
+ * With mapped-ram, each RAM block entry of the RAM_SAVE_FLAG_MEM_SIZE
+ * section is followed by a header giving the file offsets of the block's
+ * page bitmap and page area.  The pages themselves never appear in the
+ * stream; the stream carries on right after the page area.
+ */
+#define MAPPED_RAM_HDR_VERSION 1
+#define MAPPED_RAM_FILE_OFFSET_ALIGNMENT (1 * MiB)
+
+/*
+ * The file bitmap is little endian and padded to 64 bits, so that its
+ * size does not depend on the host word size.
+ */
+static size_t mapped_ram_bitmap_size(unsigned long num_pages)
+{
+    return DIV_ROUND_UP(num_pages, 64) * sizeof(uint64_t);
+}
 
 XBZRLECacheStats xbzrle_counters;
 
@@ -291,10 +313,21 @@ struct RAMSrcPageRequest {
     RAMBlock *rb;
     hwaddr    offset;
     hwaddr    len;
+    /* Not faulted on by the destination, only sent speculatively */
+    bool      prefetch;
 
     QSIMPLEQ_ENTRY(RAMSrcPageRequest) next_req;
 };
 
+typedef struct BitmapSyncWorker BitmapSyncWorker;
+
+/* A page sent with page-dedup on, see ram_save_dedup_page() */
+typedef struct PageDedupEntry {
+    uint64_t hash;
+    RAMBlock *block;            /* NULL if the entry is unused */
+    ram_addr_t offset;
+} PageDedupEntry;
+
 /* State of RAM for migration */
 struct RAMState {
     /* QEMUFile used for this migration */
@@ -336,6 +369,11 @@ struct RAMState {
     /* amount of compressed pages */
     uint64_t compress_pages_prev;
 
+    /* per-vcpu dirty pages at the beginning of period, by cpu_index */
+    uint64_t *vcpu_dirty_pages_prev;
+    /* number of entries in vcpu_dirty_pages_prev */
+    unsigned int vcpu_dirty_pages_count;
+
     /* total handled target pages at the beginning of period */
     uint64_t target_page_count_prev;
     /* total handled target pages since start */
@@ -344,8 +382,34 @@ struct RAMState {
     uint64_t migration_dirty_pages;
     /* Protects modification of the bitmap and migration dirty pages */
     QemuMutex bitmap_mutex;
+    /*
+     * Threads that help the migration thread sync the dirty bitmap,
+     * started on the first sync that has several chunks to process
+     */
+    BitmapSyncWorker *bitmap_sync_workers;
+    int nr_bitmap_sync_workers;
+    /* posted by a worker when it is done with a sync */
+    QemuSemaphore bitmap_sync_done;
     /* The RAMBlock used in the last src_page_requests */
     RAMBlock *last_req_rb;
+    /*
+     * Adaptive postcopy prefetch: the range that was prefetched after the
+     * last request, and how many request-sized chunks were prefetched.
+     * Only touched by the return path thread.
+     */
+    RAMBlock *prefetch_rb;
+    ram_addr_t prefetch_start;
+    ram_addr_t prefetch_end;
+    unsigned int prefetch_window;
+    /*
+     * page-dedup: recently sent pages indexed by content hash, the index
+     * plus one of each of them in dedup_table indexed by page address,
+     * and a copy of the page being sent.  NULL if page-dedup is off.
+     */
+    PageDedupEntry *dedup_table;
+    uint32_t *dedup_slot;
+    uint32_t dedup_mask;
+    uint8_t *dedup_buf;
     /* Queue of outstanding page requests from the destination */
     QemuMutex src_page_req_mutex;
     QSIMPLEQ_HEAD(, RAMSrcPageRequest) src_page_requests;
@@ -656,6 +720,49 @@ static void mig_throttle_guest_down(uint64_t bytes_dirty_period,
     }
 }
 
+/**
+ * mig_throttle_vcpus: spread the throttle over the vcpus
+ *
+ * Give each vcpu a share of the current throttle percentage proportional
+ * to the pages it dirtied in the last period, so that the vcpu dirtying
+ * the most memory is throttled fully and vcpus that do not write to
+ * memory keep running at full speed.  Per-vcpu dirty counts come from
+ * the KVM dirty ring.
+ *
+ * @rs: current RAM state
+ */
+static void mig_throttle_vcpus(RAMState *rs)
+{
+    int pct = cpu_throttle_get_percentage();
+    uint64_t max_dirty = 0;
+    CPUState *cpu;
+
+    CPU_FOREACH(cpu) {
+        if (cpu->cpu_index < rs->vcpu_dirty_pages_count) {
+            max_dirty = MAX(max_dirty, cpu->dirty_pages -
+                            rs->vcpu_dirty_pages_prev[cpu->cpu_index]);
+        }
+    }
+
+    CPU_FOREACH(cpu) {
+        uint64_t dirty;
+        int vcpu_pct;
+
+        if (cpu->cpu_index >= rs->vcpu_dirty_pages_count) {
+            continue;
+        }
+        dirty = cpu->dirty_pages - rs->vcpu_dirty_pages_prev[cpu->cpu_index];
+        rs->vcpu_dirty_pages_prev[cpu->cpu_index] = cpu->dirty_pages;
+        if (!pct) {
+            continue;
+        }
+
+        vcpu_pct = max_dirty ? DIV_ROUND_UP(pct * dirty, max_dirty) : 0;
+        trace_migration_throttle_vcpu(cpu->cpu_index, dirty, vcpu_pct);
+        cpu_throttle_set_vcpu(cpu, vcpu_pct);
+    }
+}
+
 void mig_throttle_counter_reset(void)
 {
     RAMState *rs = ram_state;
@@ -1003,6 +1110,194 @@ static void ramblock_sync_dirty_bitmap(RAMState *rs, RAMBlock *rb)
     rs->num_dirty_pages_period += new_dirty_pages;
 }
 
+typedef struct BitmapSyncChunk {
+    RAMBlock *rb;
+    ram_addr_t start;
+    ram_addr_t length;
+} BitmapSyncChunk;
+
+typedef struct BitmapSyncState {
+    BitmapSyncChunk *chunks;
+    int nr_chunks;
+    /* next chunk to process, taken with qatomic_fetch_inc() */
+    int next;
+} BitmapSyncState;
+
+struct BitmapSyncWorker {
+    QemuThread thread;
+    /* posted by the migration thread to start a sync, or to quit */
+    QemuSemaphore sem;
+    QemuSemaphore *done;
+    bool quit;
+    BitmapSyncState *state;
+    uint64_t new_dirty_pages;
+};
+
+/*
+ * Chunks start at multiples of BITS_PER_LONG pages within the block, so
+ * no two chunks share a word of rb->bmap and they can be merged without
+ * locking; the global dirty bitmap and clear_bmap are updated atomically
+ * by cpu_physical_memory_sync_dirty_bitmap().
+ */
+static uint64_t bitmap_sync_run(BitmapSyncState *state)
+{
+    uint64_t new_dirty_pages = 0;
+    int i;
+
+    while ((i = qatomic_fetch_inc(&state->next)) < state->nr_chunks) {
+        BitmapSyncChunk *chunk = &state->chunks[i];
+
+        new_dirty_pages += cpu_physical_memory_sync_dirty_bitmap(
+            chunk->rb, chunk->start, chunk->length);
+    }
+    return new_dirty_pages;
+}
+
+static void *bitmap_sync_thread(void *opaque)
+{
+    BitmapSyncWorker *worker = opaque;
+
+    rcu_register_thread();
+    while (true) {
+        qemu_sem_wait(&worker->sem);
+        if (qatomic_read(&worker->quit)) {
+            break;
+        }
+        WITH_RCU_READ_LOCK_GUARD() {
+            worker->new_dirty_pages = bitmap_sync_run(worker->state);
+        }
+        qemu_sem_post(worker->done);
+    }
+    rcu_unregister_thread();
+    return NULL;
+}
+
+static void bitmap_sync_workers_start(RAMState *rs, int nr_workers)
+{
+    int i;
+
+    qemu_sem_init(&rs->bitmap_sync_done, 0);
+    rs->bitmap_sync_workers = g_new0(BitmapSyncWorker, nr_workers);
+    for (i = 0; i < nr_workers; i++) {
+        BitmapSyncWorker *worker = &rs->bitmap_sync_workers[i];
+
+        qemu_sem_init(&worker->sem, 0);
+        worker->done = &rs->bitmap_sync_done;
+        qemu_thread_create(&worker->thread, "mig/bmap-sync",
+                           bitmap_sync_thread, worker,
+                           QEMU_THREAD_JOINABLE);
+    }
+    rs->nr_bitmap_sync_workers = nr_workers;
+}
+
+static void bitmap_sync_workers_stop(RAMState *rs)
+{
+    int i;
+
+    if (!rs->bitmap_sync_workers) {
+        return;
+    }
+    for (i = 0; i < rs->nr_bitmap_sync_workers; i++) {
+        BitmapSyncWorker *worker = &rs->bitmap_sync_workers[i];
+
+        qatomic_set(&worker->quit, true);
+        qemu_sem_post(&worker->sem);
+        qemu_thread_join(&worker->thread);
+        qemu_sem_destroy(&worker->sem);
+    }
+    qemu_sem_destroy(&rs->bitmap_sync_done);
+    g_free(rs->bitmap_sync_workers);
+    rs->bitmap_sync_workers = NULL;
+    rs->nr_bitmap_sync_workers = 0;
+}
+
+/**
+ * ram_sync_dirty_bitmaps: sync the dirty bitmap of every RAMBlock
+ *
+ * Large RAMBlocks are split into chunks that are synced by up to
+ * x-bitmap-sync-threads threads, the migration thread included.  The
+ * other threads are started by the first sync that needs them and stay
+ * around until the end of the migration.  With a single thread, or a
+ * single chunk, this is the same as calling ramblock_sync_dirty_bitmap()
+ * on each block.
+ *
+ * Called with the RCU read lock and rs->bitmap_mutex held.
+ *
+ * @rs: current RAM state
+ */
+static void ram_sync_dirty_bitmaps(RAMState *rs)
+{
+    MigrationState *ms = migrate_get_current();
+    int nr_threads = ms->bitmap_sync_threads;
+    ram_addr_t min_chunk_size = (ram_addr_t)TARGET_PAGE_SIZE * BITS_PER_LONG;
+    BitmapSyncState state = { 0 };
+    uint64_t new_dirty_pages;
+    RAMBlock *block;
+    int i;
+
+    if (nr_threads > 1) {
+        RAMBLOCK_FOREACH_NOT_IGNORED(block) {
+            state.nr_chunks += DIV_ROUND_UP(block->used_length,
+                                            MAX(ms->bitmap_sync_chunk_size,
+                                                min_chunk_size));
+        }
+    }
+
+    if (state.nr_chunks <= 1) {
+        RAMBLOCK_FOREACH_NOT_IGNORED(block) {
+            ramblock_sync_dirty_bitmap(rs, block);
+        }
+        return;
+    }
+
+    state.chunks = g_new(BitmapSyncChunk, state.nr_chunks);
+    i = 0;
+    RAMBLOCK_FOREACH_NOT_IGNORED(block) {
+        ram_addr_t align = min_chunk_size;
+        ram_addr_t chunk_size;
+        ram_addr_t start;
+
+        /* keep chunks aligned to what one clear_bmap bit covers */
+        if (block->clear_bmap) {
+            align = MAX(align, (ram_addr_t)TARGET_PAGE_SIZE <<
+                               block->clear_bmap_shift);
+        }
+        chunk_size = ROUND_UP(MAX(ms->bitmap_sync_chunk_size, align), align);
+        for (start = 0; start < block->used_length; start += chunk_size) {
+            state.chunks[i].rb = block;
+            state.chunks[i].start = start;
+            state.chunks[i].length = MIN(chunk_size,
+                                         block->used_length - start);
+            i++;
+        }
+    }
+    state.nr_chunks = i;
+
+    if (!rs->bitmap_sync_workers) {
+        bitmap_sync_workers_start(rs, nr_threads - 1);
+    }
+    nr_threads = MIN(nr_threads, state.nr_chunks);
+    for (i = 0; i < nr_threads - 1; i++) {
+        rs->bitmap_sync_workers[i].state = &state;
+        qemu_sem_post(&rs->bitmap_sync_workers[i].sem);
+    }
+
+    new_dirty_pages = bitmap_sync_run(&state);
+
+    for (i = 0; i < nr_threads - 1; i++) {
+        qemu_sem_wait(&rs->bitmap_sync_done);
+    }
+    for (i = 0; i < nr_threads - 1; i++) {
+        new_dirty_pages += rs->bitmap_sync_workers[i].new_dirty_pages;
+    }
+
+    rs->migration_dirty_pages += new_dirty_pages;
+    rs->num_dirty_pages_period += new_dirty_pages;
+    trace_ram_sync_dirty_bitmaps(state.nr_chunks, nr_threads);
+
+    g_free(state.chunks);
+}
+
 /**
  * ram_pagesize_summary: calculate all the pagesizes of a VM
  *
@@ -1027,7 +1322,8 @@ uint64_t ram_pagesize_summary(void)
 uint64_t ram_get_total_transferred_pages(void)
 {
     return  ram_counters.normal + ram_counters.duplicate +
-                compression_counters.pages + xbzrle_counters.pages;
+                compression_counters.pages + xbzrle_counters.pages +
+                ram_counters.dedup_pages;
 }
 
 static void migration_update_rates(RAMState *rs, int64_t end_time)
@@ -1061,7 +1357,7 @@ static void migration_update_rates(RAMState *rs, int64_t end_time)
         rs->xbzrle_bytes_prev = xbzrle_counters.bytes;
     }
 
-    if (migrate_use_compression()) {
+    if (migrate_use_compression() || migrate_use_multifd_compression()) {
         compression_counters.busy_rate = (double)(compression_counters.busy -
             rs->compress_thread_busy_prev) / page_count;
         rs->compress_thread_busy_prev = compression_counters.busy;
@@ -1108,12 +1404,16 @@ static void migration_trigger_throttle(RAMState *rs)
             mig_throttle_guest_down(bytes_dirty_period,
                                     bytes_dirty_threshold);
         }
+
+        if (migrate_auto_converge_per_vcpu()) {
+            mig_throttle_vcpus(rs);
+        }
     }
 }
 
 static void migration_bitmap_sync(RAMState *rs)
 {
-    RAMBlock *block;
+    int64_t start_us = qemu_clock_get_us(QEMU_CLOCK_REALTIME);
     int64_t end_time;
 
     ram_counters.dirty_sync_count++;
@@ -1127,15 +1427,15 @@ static void migration_bitmap_sync(RAMState *rs)
 
     qemu_mutex_lock(&rs->bitmap_mutex);
     WITH_RCU_READ_LOCK_GUARD() {
-        RAMBLOCK_FOREACH_NOT_IGNORED(block) {
-            ramblock_sync_dirty_bitmap(rs, block);
-        }
+        ram_sync_dirty_bitmaps(rs);
         ram_counters.remaining = ram_bytes_remaining();
     }
     qemu_mutex_unlock(&rs->bitmap_mutex);
 
     memory_global_after_dirty_log_sync();
-    trace_migration_bitmap_sync_end(rs->num_dirty_pages_period);
+    trace_migration_bitmap_sync_end(rs->num_dirty_pages_period,
+                                    qemu_clock_get_us(QEMU_CLOCK_REALTIME) -
+                                    start_us);
 
     end_time = qemu_clock_get_ms(QEMU_CLOCK_REALTIME);
 
@@ -1345,6 +1645,176 @@ static int ram_save_page(RAMState *rs, PageSearchStatus *pss)
     return pages;
 }
 
+/* XXH64 of a target page */
+static uint64_t page_dedup_hash(const uint8_t *p)
+{
+    uint64_t v1 = QEMU_XXHASH_SEED + XXH_PRIME64_1 + XXH_PRIME64_2;
+    uint64_t v2 = QEMU_XXHASH_SEED + XXH_PRIME64_2;
+    uint64_t v3 = QEMU_XXHASH_SEED + 0;
+    uint64_t v4 = QEMU_XXHASH_SEED - XXH_PRIME64_1;
+    size_t i;
+
+    for (i = 0; i < TARGET_PAGE_SIZE; i += 32) {
+        v1 = XXH64_round(v1, ldq_he_p(p + i));
+        v2 = XXH64_round(v2, ldq_he_p(p + i + 8));
+        v3 = XXH64_round(v3, ldq_he_p(p + i + 16));
+        v4 = XXH64_round(v4, ldq_he_p(p + i + 24));
+    }
+
+    return XXH64_avalanche(XXH64_mergerounds(v1, v2, v3, v4) +
+                           TARGET_PAGE_SIZE);
+}
+
+static uint32_t *page_dedup_slot(RAMState *rs, RAMBlock *block,
+                                 ram_addr_t offset)
+{
+    ram_addr_t addr = block->offset + offset;
+
+    return &rs->dedup_slot[qemu_xxhash2(addr >> TARGET_PAGE_BITS) &
+                           rs->dedup_mask];
+}
+
+/*
+ * page_dedup_forget: drop the entry for a page that is being sent again
+ *
+ * The destination copy of the page is about to change, so it can no
+ * longer be referenced.  Every entry can be found through dedup_slot:
+ * page_dedup_insert() evicts entries rather than letting two of them
+ * share a slot.
+ *
+ * @rs: current RAM state
+ * @block: block that contains the page
+ * @offset: offset inside the block for the page
+ */
+static void page_dedup_forget(RAMState *rs, RAMBlock *block,
+                              ram_addr_t offset)
+{
+    uint32_t *slot = page_dedup_slot(rs, block, offset);
+    PageDedupEntry *e;
+
+    if (!*slot) {
+        return;
+    }
+    e = &rs->dedup_table[*slot - 1];
+    if (e->block == block && e->offset == offset) {
+        e->block = NULL;
+        *slot = 0;
+    }
+}
+
+static void page_dedup_insert(RAMState *rs, uint64_t hash, RAMBlock *block,
+                              ram_addr_t offset)
+{
+    uint32_t idx = hash & rs->dedup_mask;
+    PageDedupEntry *e = &rs->dedup_table[idx];
+    uint32_t *slot = page_dedup_slot(rs, block, offset);
+
+    if (*slot) {
+        rs->dedup_table[*slot - 1].block = NULL;
+    }
+    if (e->block) {
+        *page_dedup_slot(rs, e->block, e->offset) = 0;
+    }
+    e->hash = hash;
+    e->block = block;
+    e->offset = offset;
+    *slot = idx + 1;
+}
+
+/*
+ * ram_save_dedup_page: send a page, as a reference to an identical page
+ * sent earlier if there is one
+ *
+ * The page is copied first, so that what is hashed is exactly what the
+ * destination gets even if the guest keeps writing to it.  An entry in
+ * dedup_table thus describes the destination copy of its page, which
+ * stays valid until page_dedup_forget(); comparing with the source copy
+ * only guards against hash collisions.  The data of a page sent in full
+ * is then copied a second time into the QEMUFile buffer, which is also
+ * why page-dedup excludes zero-copy-send.
+ *
+ * Returns the number of pages written.
+ *
+ * @rs: current RAM state
+ * @block: block that contains the page we want to send
+ * @offset: offset inside the block for the page
+ */
+static int ram_save_dedup_page(RAMState *rs, RAMBlock *block,
+                               ram_addr_t offset)
+{
+    uint8_t *buf = rs->dedup_buf;
+    PageDedupEntry *e;
+    uint64_t hash;
+    size_t len;
+
+    memcpy(buf, block->host + offset, TARGET_PAGE_SIZE);
+    hash = page_dedup_hash(buf);
+    e = &rs->dedup_table[hash & rs->dedup_mask];
+
+    if (!e->block || e->hash != hash ||
+        memcmp(buf, e->block->host + e->offset, TARGET_PAGE_SIZE)) {
+        page_dedup_insert(rs, hash, block, offset);
+        return save_normal_page(rs, block, offset, buf, false);
+    }
+
+    trace_ram_save_dedup_page(block->idstr, (uint64_t)offset,
+                              e->block->idstr, (uint64_t)e->offset);
+    len = save_page_header(rs, rs->f, block, offset | RAM_SAVE_FLAG_DEDUP);
+    /* An empty name stands for the block of the page itself */
+    if (e->block == block) {
+        qemu_put_byte(rs->f, 0);
+        len += 1;
+    } else {
+        size_t name_len = strlen(e->block->idstr);
+
+        qemu_put_byte(rs->f, name_len);
+        qemu_put_buffer(rs->f, (uint8_t *)e->block->idstr, name_len);
+        len += 1 + name_len;
+    }
+    qemu_put_be64(rs->f, e->offset);
+    len += 8;
+    ram_transferred_add(len);
+    ram_counters.dedup_pages++;
+    return 1;
+}
+
+/*
+ * save_mapped_ram_page: write the page at its fixed place in the file
+ *
+ * Returns the number of pages written or negative on error.
+ *
+ * @rs: current RAM state
+ * @block: block that contains the page we want to send
+ * @offset: offset inside the block for the page
+ */
+static int save_mapped_ram_page(RAMState *rs, RAMBlock *block,
+                                ram_addr_t offset)
+{
+    uint8_t *p = block->host + offset;
+    unsigned long page = offset >> TARGET_PAGE_BITS;
+
+    if (buffer_is_zero(p, TARGET_PAGE_SIZE)) {
+        /*
+         * Incoming RAM starts out zeroed, so it is enough to drop whatever
+         * an earlier iteration wrote for this page.
+         */
+        clear_bit(page, block->file_bmap);
+        ram_counters.duplicate++;
+        return 1;
+    }
+
+    qemu_put_buffer_at(rs->f, p, TARGET_PAGE_SIZE,
+                       block->pages_offset + offset);
+    if (qemu_file_get_error(rs->f)) {
+        return -1;
+    }
+    set_bit(page, block->file_bmap);
+    ram_transferred_add(TARGET_PAGE_SIZE);
+    ram_counters.normal++;
+
+    return 1;
+}
+
 static int ram_save_multifd_page(RAMState *rs, RAMBlock *block,
                                  ram_addr_t offset)
 {
@@ -2008,6 +2478,86 @@ static void migration_page_queue_free(RAMState *rs)
     }
 }
 
+/*
+ * Queue a page request, faulted pages go ahead of any pending prefetch so
+ * that speculation never delays a vCPU that is actually blocked.
+ * Called with src_page_req_mutex held.
+ */
+static void ram_queue_page_request(RAMState *rs, RAMBlock *rb,
+                                   ram_addr_t start, ram_addr_t len,
+                                   bool prefetch)
+{
+    struct RAMSrcPageRequest *new_entry, *entry, *prev = NULL;
+
+    new_entry = g_malloc0(sizeof(struct RAMSrcPageRequest));
+    new_entry->rb = rb;
+    new_entry->offset = start;
+    new_entry->len = len;
+    new_entry->prefetch = prefetch;
+    memory_region_ref(rb->mr);
+
+    if (!prefetch) {
+        QSIMPLEQ_FOREACH(entry, &rs->src_page_requests, next_req) {
+            if (entry->prefetch) {
+                break;
+            }
+            prev = entry;
+        }
+        if (entry) {
+            if (prev) {
+                QSIMPLEQ_INSERT_AFTER(&rs->src_page_requests, prev,
+                                      new_entry, next_req);
+            } else {
+                QSIMPLEQ_INSERT_HEAD(&rs->src_page_requests, new_entry,
+                                     next_req);
+            }
+            migration_make_urgent_request();
+            return;
+        }
+    }
+
+    QSIMPLEQ_INSERT_TAIL(&rs->src_page_requests, new_entry, next_req);
+    migration_make_urgent_request();
+}
+
+/*
+ * Work out how much to prefetch after a request for @start..@start+@len.
+ *
+ * Like file readahead, the window doubles (up to x-postcopy-prefetch-max
+ * requests worth of memory) while the destination keeps faulting in or
+ * right after the range prefetched last time, and halves on every fault
+ * elsewhere, so that random access patterns quickly stop paying for
+ * useless prefetches.
+ *
+ * Returns the length to prefetch from @start + @len, possibly zero.
+ */
+static ram_addr_t ram_prefetch_len(RAMState *rs, RAMBlock *rb,
+                                   ram_addr_t start, ram_addr_t len)
+{
+    unsigned int max = migrate_get_current()->postcopy_prefetch_max;
+    ram_addr_t pf_start = start + len;
+    ram_addr_t pf_len = 0;
+
+    if (rb == rs->prefetch_rb && start >= rs->prefetch_start &&
+        start <= rs->prefetch_end) {
+        rs->prefetch_window = MIN(MAX(rs->prefetch_window * 2, 1), max);
+    } else {
+        rs->prefetch_window = MIN(rs->prefetch_window / 2, max);
+    }
+
+    if (pf_start < rb->used_length) {
+        pf_len = MIN((ram_addr_t)rs->prefetch_window * len,
+                     rb->used_length - pf_start);
+        pf_len = ROUND_DOWN(pf_len, qemu_ram_pagesize(rb));
+    }
+
+    rs->prefetch_rb = rb;
+    rs->prefetch_start = pf_start;
+    rs->prefetch_end = pf_start + pf_len;
+
+    return pf_len;
+}
+
 /**
  * ram_save_queue_pages: queue the page for transmission
  *
@@ -2024,6 +2574,7 @@ int ram_save_queue_pages(const char *rbname, ram_addr_t start, ram_addr_t len)
 {
     RAMBlock *ramblock;
     RAMState *rs = ram_state;
+    ram_addr_t pf_len;
 
     ram_counters.postcopy_requests++;
     RCU_READ_LOCK_GUARD();
@@ -2058,16 +2609,15 @@ int ram_save_queue_pages(const char *rbname, ram_addr_t start, ram_addr_t len)
         return -1;
     }
 
-    struct RAMSrcPageRequest *new_entry =
-        g_malloc0(sizeof(struct RAMSrcPageRequest));
-    new_entry->rb = ramblock;
-    new_entry->offset = start;
-    new_entry->len = len;
+    pf_len = ram_prefetch_len(rs, ramblock, start, len);
+    trace_ram_save_queue_prefetch(ramblock->idstr, start + len, pf_len,
+                                  rs->prefetch_window);
 
-    memory_region_ref(ramblock->mr);
     qemu_mutex_lock(&rs->src_page_req_mutex);
-    QSIMPLEQ_INSERT_TAIL(&rs->src_page_requests, new_entry, next_req);
-    migration_make_urgent_request();
+    ram_queue_page_request(rs, ramblock, start, len, false);
+    if (pf_len) {
+        ram_queue_page_request(rs, ramblock, start + len, pf_len, true);
+    }
     qemu_mutex_unlock(&rs->src_page_req_mutex);
 
     return 0;
@@ -2137,27 +2687,23 @@ static int ram_save_target_page(RAMState *rs, PageSearchStatus *pss)
 {
     RAMBlock *block = pss->block;
     ram_addr_t offset = ((ram_addr_t)pss->page) << TARGET_PAGE_BITS;
+    bool use_multifd;
     int res;
 
+    if (rs->dedup_table) {
+        page_dedup_forget(rs, block, offset);
+    }
+
     if (control_save_page(rs, block, offset, &res)) {
         return res;
     }
 
-    if (save_compress_page(rs, block, offset)) {
-        return 1;
+    if (migrate_mapped_ram()) {
+        return save_mapped_ram_page(rs, block, offset);
     }
 
-    res = save_zero_page(rs, block, offset);
-    if (res > 0) {
-        /* Must let xbzrle know, otherwise a previous (now 0'd) cached
-         * page would be stale
-         */
-        if (!save_page_use_compression(rs)) {
-            XBZRLE_cache_lock();
-            xbzrle_cache_zero_page(rs, block->offset + offset);
-            XBZRLE_cache_unlock();
-        }
-        return res;
+    if (save_compress_page(rs, block, offset)) {
+        return 1;
     }
 
     /*
@@ -2166,8 +2712,35 @@ static int ram_save_target_page(RAMState *rs, PageSearchStatus *pss)
      *    before sending the compressed page
      * 2. In postcopy as one whole host page should be placed
      */
-    if (!save_page_use_compression(rs) && migrate_use_multifd()
-        && !migration_in_postcopy()) {
+    use_multifd = !save_page_use_compression(rs) && migrate_use_multifd()
+                  && !migration_in_postcopy();
+
+    /* multifd channels check for zero pages themselves */
+    if (!use_multifd || !migrate_multifd_zero_page()) {
+        res = save_zero_page(rs, block, offset);
+        if (res > 0) {
+            /*
+             * Must let xbzrle know, otherwise a previous (now 0'd) cached
+             * page would be stale
+             */
+            if (!save_page_use_compression(rs)) {
+                XBZRLE_cache_lock();
+                xbzrle_cache_zero_page(rs, block->offset + offset);
+                XBZRLE_cache_unlock();
+            }
+            return res;
+        }
+    }
+
+    /*
+     * Not in postcopy: the destination places whole host pages atomically
+     * there, and discards the pages dirtied during precopy on the switch.
+     */
+    if (rs->dedup_table && !migration_in_postcopy()) {
+        return ram_save_dedup_page(rs, block, offset);
+    }
+
+    if (use_multifd) {
         return ram_save_multifd_page(rs, block, offset);
     }
 
@@ -2337,6 +2910,11 @@ static void ram_state_cleanup(RAMState **rsp)
 {
     if (*rsp) {
         migration_page_queue_free(*rsp);
+        bitmap_sync_workers_stop(*rsp);
+        g_free((*rsp)->vcpu_dirty_pages_prev);
+        g_free((*rsp)->dedup_table);
+        g_free((*rsp)->dedup_slot);
+        qemu_vfree((*rsp)->dedup_buf);
         qemu_mutex_destroy(&(*rsp)->bitmap_mutex);
         qemu_mutex_destroy(&(*rsp)->src_page_req_mutex);
         g_free(*rsp);
@@ -2385,6 +2963,8 @@ static void ram_save_cleanup(void *opaque)
         block->clear_bmap = NULL;
         g_free(block->bmap);
         block->bmap = NULL;
+        g_free(block->file_bmap);
+        block->file_bmap = NULL;
     }
 
     xbzrle_cleanup();
@@ -2708,6 +3288,32 @@ static int ram_state_init(RAMState **rsp)
     (*rsp)->migration_dirty_pages = ram_bytes_total() >> TARGET_PAGE_BITS;
     ram_state_reset(*rsp);
 
+    if (migrate_auto_converge_per_vcpu()) {
+        unsigned int max_cpus = current_machine->smp.max_cpus;
+        CPUState *cpu;
+
+        (*rsp)->vcpu_dirty_pages_count = max_cpus;
+        (*rsp)->vcpu_dirty_pages_prev = g_new0(uint64_t, max_cpus);
+        WITH_RCU_READ_LOCK_GUARD() {
+            CPU_FOREACH(cpu) {
+                if (cpu->cpu_index < max_cpus) {
+                    (*rsp)->vcpu_dirty_pages_prev[cpu->cpu_index] =
+                        cpu->dirty_pages;
+                }
+            }
+        }
+    }
+
+    if (migrate_page_dedup()) {
+        uint32_t entries = migrate_get_current()->page_dedup_entries;
+
+        entries = pow2floor(MAX(entries, 1));
+        (*rsp)->dedup_mask = entries - 1;
+        (*rsp)->dedup_table = g_new0(PageDedupEntry, entries);
+        (*rsp)->dedup_slot = g_new0(uint32_t, entries);
+        (*rsp)->dedup_buf = qemu_memalign(TARGET_PAGE_SIZE, TARGET_PAGE_SIZE);
+    }
+
     return 0;
 }
 
@@ -2891,6 +3497,66 @@ void qemu_guest_free_page_hint(void *addr, size_t len)
  * granularity of these critical sections.
  */
 
+/*
+ * mapped_ram_setup_ramblock: lay out @block in the migration file
+ *
+ * Writes the mapped-ram header of @block to the stream and reserves the
+ * space for its page bitmap and pages right after it; the stream resumes
+ * past the reserved area.
+ *
+ * @f: QEMUFile where to send the data
+ * @block: RAM block being described
+ */
+static void mapped_ram_setup_ramblock(QEMUFile *f, RAMBlock *block)
+{
+    unsigned long num_pages = block->used_length >> TARGET_PAGE_BITS;
+    size_t bitmap_size = mapped_ram_bitmap_size(num_pages);
+    /* version, page size, bitmap and pages offsets */
+    off_t header_size = 2 * sizeof(uint32_t) + 2 * sizeof(uint64_t);
+    off_t header_offset;
+
+    header_offset = qemu_get_offset(f);
+    if (header_offset < 0) {
+        return;
+    }
+
+    block->file_bmap = bitmap_new(num_pages);
+    block->bitmap_offset = header_offset + header_size;
+    block->pages_offset = ROUND_UP(block->bitmap_offset + bitmap_size,
+                                   MAPPED_RAM_FILE_OFFSET_ALIGNMENT);
+
+    qemu_put_be32(f, MAPPED_RAM_HDR_VERSION);
+    qemu_put_be32(f, TARGET_PAGE_SIZE);
+    qemu_put_be64(f, block->bitmap_offset);
+    qemu_put_be64(f, block->pages_offset);
+
+    qemu_set_offset(f, block->pages_offset + block->used_length);
+}
+
+/*
+ * mapped_ram_write_bitmaps: record which pages of the file are valid
+ *
+ * Must run once no more pages will be written, the file is not
+ * loadable before that.
+ *
+ * @f: QEMUFile where to send the data
+ */
+static void mapped_ram_write_bitmaps(QEMUFile *f)
+{
+    RAMBlock *block;
+
+    RAMBLOCK_FOREACH_MIGRATABLE(block) {
+        unsigned long num_pages = block->used_length >> TARGET_PAGE_BITS;
+        size_t bitmap_size = mapped_ram_bitmap_size(num_pages);
+        g_autofree unsigned long *le_bitmap =
+            bitmap_new(ROUND_UP(num_pages, 64));
+
+        bitmap_to_le(le_bitmap, block->file_bmap, num_pages);
+        qemu_put_buffer_at(f, (uint8_t *)le_bitmap, bitmap_size,
+                           block->bitmap_offset);
+    }
+}
+
 /**
  * ram_save_setup: Setup RAM for migration
  *
@@ -2904,6 +3570,12 @@ static int ram_save_setup(QEMUFile *f, void *opaque)
     RAMState **rsp = opaque;
     RAMBlock *block;
 
+    if (migrate_mapped_ram() && !qemu_file_is_seekable(f)) {
+        error_report("mapped-ram requires the migration channel "
+                     "to be a regular file");
+        return -1;
+    }
+
     if (compress_threads_save_setup()) {
         return -1;
     }
@@ -2931,6 +3603,9 @@ static int ram_save_setup(QEMUFile *f, void *opaque)
             if (migrate_ignore_shared()) {
                 qemu_put_be64(f, block->mr->addr);
             }
+            if (migrate_mapped_ram()) {
+                mapped_ram_setup_ramblock(f, block);
+            }
         }
     }
 
@@ -3103,6 +3778,9 @@ static int ram_save_complete(QEMUFile *f, void *opaque)
         }
 
         flush_compressed_data(rs);
+        if (ret >= 0 && migrate_mapped_ram()) {
+            mapped_ram_write_bitmaps(f);
+        }
         ram_control_after_iterate(f, RAM_CONTROL_FINISH);
     }
 
@@ -3868,6 +4546,129 @@ void colo_flush_ram_cache(void)
     trace_colo_flush_ram_cache_end();
 }
 
+/**
+ * mapped_ram_read_ramblock: load the pages of a mapped-ram block
+ *
+ * Parses the block header that follows the block entry in the stream,
+ * reads every page recorded in the file bitmap straight into guest
+ * memory, coalescing consecutive pages into a single read, and moves
+ * the stream past the page area.
+ *
+ * Returns 0 for success or -errno in case of error
+ *
+ * @f: QEMUFile where to receive the data
+ * @block: RAM block being loaded
+ * @length: length of the block on the source
+ */
+static int mapped_ram_read_ramblock(QEMUFile *f, RAMBlock *block,
+                                    ram_addr_t length)
+{
+    unsigned long num_pages = length >> TARGET_PAGE_BITS;
+    size_t bitmap_size = mapped_ram_bitmap_size(num_pages);
+    g_autofree unsigned long *le_bitmap = NULL;
+    g_autofree unsigned long *bitmap = NULL;
+    unsigned long run_start, run_end;
+    uint64_t bitmap_offset, pages_offset;
+    uint32_t version, page_size;
+
+    if (!qemu_file_is_seekable(f)) {
+        error_report("mapped-ram requires the migration channel "
+                     "to be a regular file");
+        return -EINVAL;
+    }
+
+    version = qemu_get_be32(f);
+    page_size = qemu_get_be32(f);
+    bitmap_offset = qemu_get_be64(f);
+    pages_offset = qemu_get_be64(f);
+
+    if (version != MAPPED_RAM_HDR_VERSION) {
+        error_report("Unsupported mapped-ram version %" PRIu32
+                     " for block %s", version, block->idstr);
+        return -EINVAL;
+    }
+    if (page_size != TARGET_PAGE_SIZE) {
+        error_report("Mismatched mapped-ram page size %" PRIu32
+                     " for block %s", page_size, block->idstr);
+        return -EINVAL;
+    }
+
+    le_bitmap = bitmap_new(ROUND_UP(num_pages, 64));
+    if (qemu_get_buffer_at(f, (uint8_t *)le_bitmap, bitmap_size,
+                           bitmap_offset) != bitmap_size) {
+        return qemu_file_get_error(f) ?: -EIO;
+    }
+    bitmap = bitmap_new(num_pages);
+    bitmap_from_le(bitmap, le_bitmap, num_pages);
+
+    for (run_start = find_first_bit(bitmap, num_pages);
+         run_start < num_pages;
+         run_start = find_next_bit(bitmap, num_pages, run_end)) {
+        ram_addr_t offset = (ram_addr_t)run_start << TARGET_PAGE_BITS;
+        size_t size;
+        void *host;
+
+        run_end = find_next_zero_bit(bitmap, num_pages, run_start + 1);
+        size = (size_t)(run_end - run_start) << TARGET_PAGE_BITS;
+
+        host = host_from_ram_block_offset(block, offset);
+        if (!host || !offset_in_ramblock(block, offset + size - 1)) {
+            error_report("Illegal mapped-ram page range %" PRIx64
+                         " +%zx in block %s", (uint64_t)offset, size,
+                         block->idstr);
+            return -EINVAL;
+        }
+
+        if (qemu_get_buffer_at(f, host, size, pages_offset + offset) != size) {
+            return qemu_file_get_error(f) ?: -EIO;
+        }
+    }
+
+    qemu_set_offset(f, pages_offset + length);
+    return qemu_file_get_error(f);
+}
+
+/*
+ * load_dedup_page: copy a page from the one it duplicates
+ *
+ * The reference is a block name, empty for @block itself, and an offset
+ * within that block; see ram_save_dedup_page().
+ */
+static int load_dedup_page(QEMUFile *f, RAMBlock *block, void *host)
+{
+    RAMBlock *ref_block = block;
+    ram_addr_t ref_offset;
+    void *ref_host;
+    char id[256];
+    uint8_t len;
+
+    len = qemu_get_byte(f);
+    if (len) {
+        qemu_get_buffer(f, (uint8_t *)id, len);
+        id[len] = 0;
+        ref_block = qemu_ram_block_by_name(id);
+        if (!ref_block || ramblock_is_ignored(ref_block)) {
+            error_report("Failed to load duplicate page - bad block %s", id);
+            return -1;
+        }
+    }
+    ref_offset = qemu_get_be64(f);
+
+    if (migration_incoming_in_colo_state()) {
+        error_report("Failed to load duplicate page - not supported by COLO");
+        return -1;
+    }
+    ref_host = host_from_ram_block_offset(ref_block, ref_offset);
+    if (!ref_host || (ref_offset & ~TARGET_PAGE_MASK)) {
+        error_report("Failed to load duplicate page - bad offset "
+                     RAM_ADDR_FMT, ref_offset);
+        return -1;
+    }
+
+    memcpy(host, ref_host, TARGET_PAGE_SIZE);
+    return 0;
+}
+
 /**
  * ram_load_precopy: load pages in precopy case
  *
@@ -3889,6 +4690,7 @@ static int ram_load_precopy(QEMUFile *f)
 
     while (!ret && !(flags & RAM_SAVE_FLAG_EOS)) {
         ram_addr_t addr, total_ram_bytes;
+        RAMBlock *dedup_block = NULL;
         void *host = NULL, *host_bak = NULL;
         uint8_t ch;
 
@@ -3917,7 +4719,8 @@ static int ram_load_precopy(QEMUFile *f)
         }
 
         if (flags & (RAM_SAVE_FLAG_ZERO | RAM_SAVE_FLAG_PAGE |
-                     RAM_SAVE_FLAG_COMPRESS_PAGE | RAM_SAVE_FLAG_XBZRLE)) {
+                     RAM_SAVE_FLAG_COMPRESS_PAGE | RAM_SAVE_FLAG_XBZRLE |
+                     RAM_SAVE_FLAG_DEDUP)) {
             RAMBlock *block = ram_block_from_stream(f, flags);
 
             host = host_from_ram_block_offset(block, addr);
@@ -3952,6 +4755,9 @@ static int ram_load_precopy(QEMUFile *f)
             if (!migration_incoming_in_colo_state()) {
                 ramblock_recv_bitmap_set(block, host);
             }
+            if (flags & RAM_SAVE_FLAG_DEDUP) {
+                dedup_block = block;
+            }
 
             trace_ram_load_loop(block->idstr, (uint64_t)addr, flags, host);
         }
@@ -4007,6 +4813,9 @@ static int ram_load_precopy(QEMUFile *f)
                             ret = -EINVAL;
                         }
                     }
+                    if (!ret && migrate_mapped_ram()) {
+                        ret = mapped_ram_read_ramblock(f, block, length);
+                    }
                     ram_control_load_hook(f, RAM_CONTROL_BLOCK_REG,
                                           block->idstr);
                 } else {
@@ -4046,6 +4855,13 @@ static int ram_load_precopy(QEMUFile *f)
                 break;
             }
             break;
+        case RAM_SAVE_FLAG_DEDUP:
+            if (load_dedup_page(f, dedup_block, host) < 0) {
+                error_report("Failed to load duplicate page at "
+                             RAM_ADDR_FMT, addr);
+                ret = -EINVAL;
+            }
+            break;
         case RAM_SAVE_FLAG_EOS:
             /* normal exit */
             multifd_recv_sync_main();
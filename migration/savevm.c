@@ -131,7 +131,7 @@ static struct mig_cmd_args {
 /* savevm/loadvm support */
 
 static ssize_t block_writev_buffer(void *opaque, struct iovec *iov, int iovcnt,
-                                   int64_t pos, Error **errp)
+                                   int64_t pos, int flags, Error **errp)
 {
     int ret;
     QEMUIOVector qiov;
@@ -14,10 +14,170 @@
 #include "qemu-file.h"
 #include "migration.h"
 #include "migration/vmstate.h"
+#include "qemu/bswap.h"
 #include "qemu/error-report.h"
 #include "qemu/queue.h"
 #include "trace.h"
 
+/*
+ * Arrays of integers
+ *
+ * Rather than one get/put callback and one qemu_{get,put}_be*() per
+ * element, whole batches go through a bounce buffer that is converted
+ * from/to big endian in a tight loop and transferred with a single
+ * qemu_{get,put}_buffer().
+ */
+
+#define VMSTATE_ARRAY_BATCH 256
+
+static void cpu_to_be_array(uint8_t *dst, const uint8_t *src, size_t size,
+                            size_t width, size_t n)
+{
+    size_t i;
+
+    switch (width) {
+    case 1:
+        for (i = 0; i < n; i++) {
+            dst[i] = src[i * size];
+        }
+        break;
+    case 2:
+        for (i = 0; i < n; i++) {
+            stw_be_p(dst + i * 2, lduw_he_p(src + i * size));
+        }
+        break;
+    case 4:
+        for (i = 0; i < n; i++) {
+            stl_be_p(dst + i * 4, ldl_he_p(src + i * size));
+        }
+        break;
+    case 8:
+        for (i = 0; i < n; i++) {
+            stq_be_p(dst + i * 8, ldq_he_p(src + i * size));
+        }
+        break;
+    default:
+        g_assert_not_reached();
+    }
+}
+
+static void be_to_cpu_array(uint8_t *dst, const uint8_t *src, size_t size,
+                            size_t width, size_t n)
+{
+    size_t i;
+
+    switch (width) {
+    case 1:
+        for (i = 0; i < n; i++) {
+            dst[i * size] = src[i];
+        }
+        break;
+    case 2:
+        for (i = 0; i < n; i++) {
+            stw_he_p(dst + i * size, lduw_be_p(src + i * 2));
+        }
+        break;
+    case 4:
+        for (i = 0; i < n; i++) {
+            stl_he_p(dst + i * size, ldl_be_p(src + i * 4));
+        }
+        break;
+    case 8:
+        for (i = 0; i < n; i++) {
+            stq_he_p(dst + i * size, ldq_be_p(src + i * 8));
+        }
+        break;
+    default:
+        g_assert_not_reached();
+    }
+}
+
+static int get_be_array(QEMUFile *f, void *pv, size_t size, size_t n,
+                        size_t width)
+{
+    uint64_t buf[VMSTATE_ARRAY_BATCH];
+    size_t batch = sizeof(buf) / width;
+    uint8_t *p = pv;
+
+    if (width == 1 && size == 1) {
+        qemu_get_buffer(f, p, n);
+        return 0;
+    }
+
+    while (n) {
+        size_t count = MIN(n, batch);
+
+        qemu_get_buffer(f, (uint8_t *)buf, count * width);
+        be_to_cpu_array(p, (uint8_t *)buf, size, width, count);
+        p += count * size;
+        n -= count;
+    }
+    return 0;
+}
+
+static int put_be_array(QEMUFile *f, void *pv, size_t size, size_t n,
+                        size_t width)
+{
+    uint64_t buf[VMSTATE_ARRAY_BATCH];
+    size_t batch = sizeof(buf) / width;
+    uint8_t *p = pv;
+
+    if (width == 1 && size == 1) {
+        qemu_put_buffer(f, p, n);
+        return 0;
+    }
+
+    while (n) {
+        size_t count = MIN(n, batch);
+
+        cpu_to_be_array((uint8_t *)buf, p, size, width, count);
+        qemu_put_buffer(f, (uint8_t *)buf, count * width);
+        p += count * size;
+        n -= count;
+    }
+    return 0;
+}
+
+static int get_8bit_array(QEMUFile *f, void *pv, size_t size, size_t n)
+{
+    return get_be_array(f, pv, size, n, 1);
+}
+
+static int put_8bit_array(QEMUFile *f, void *pv, size_t size, size_t n)
+{
+    return put_be_array(f, pv, size, n, 1);
+}
+
+static int get_16bit_array(QEMUFile *f, void *pv, size_t size, size_t n)
+{
+    return get_be_array(f, pv, size, n, 2);
+}
+
+static int put_16bit_array(QEMUFile *f, void *pv, size_t size, size_t n)
+{
+    return put_be_array(f, pv, size, n, 2);
+}
+
+static int get_32bit_array(QEMUFile *f, void *pv, size_t size, size_t n)
+{
+    return get_be_array(f, pv, size, n, 4);
+}
+
+static int put_32bit_array(QEMUFile *f, void *pv, size_t size, size_t n)
+{
+    return put_be_array(f, pv, size, n, 4);
+}
+
+static int get_64bit_array(QEMUFile *f, void *pv, size_t size, size_t n)
+{
+    return get_be_array(f, pv, size, n, 8);
+}
+
+static int put_64bit_array(QEMUFile *f, void *pv, size_t size, size_t n)
+{
+    return put_be_array(f, pv, size, n, 8);
+}
+
 /* bool */
 
 static int get_bool(QEMUFile *f, void *pv, size_t size,
@@ -64,6 +224,8 @@ const VMStateInfo vmstate_info_int8 = {
     .name = "int8",
     .get  = get_int8,
     .put  = put_int8,
+    .get_array = get_8bit_array,
+    .put_array = put_8bit_array,
 };
 
 /* 16 bit int */
@@ -88,6 +250,8 @@ const VMStateInfo vmstate_info_int16 = {
     .name = "int16",
     .get  = get_int16,
     .put  = put_int16,
+    .get_array = get_16bit_array,
+    .put_array = put_16bit_array,
 };
 
 /* 32 bit int */
@@ -112,6 +276,8 @@ const VMStateInfo vmstate_info_int32 = {
     .name = "int32",
     .get  = get_int32,
     .put  = put_int32,
+    .get_array = get_32bit_array,
+    .put_array = put_32bit_array,
 };
 
 /* 32 bit int. See that the received value is the same than the one
@@ -189,6 +355,8 @@ const VMStateInfo vmstate_info_int64 = {
     .name = "int64",
     .get  = get_int64,
     .put  = put_int64,
+    .get_array = get_64bit_array,
+    .put_array = put_64bit_array,
 };
 
 /* 8 bit unsigned int */
@@ -213,6 +381,8 @@ const VMStateInfo vmstate_info_uint8 = {
     .name = "uint8",
     .get  = get_uint8,
     .put  = put_uint8,
+    .get_array = get_8bit_array,
+    .put_array = put_8bit_array,
 };
 
 /* 16 bit unsigned int */
@@ -237,6 +407,8 @@ const VMStateInfo vmstate_info_uint16 = {
     .name = "uint16",
     .get  = get_uint16,
     .put  = put_uint16,
+    .get_array = get_16bit_array,
+    .put_array = put_16bit_array,
 };
 
 /* 32 bit unsigned int */
@@ -261,6 +433,8 @@ const VMStateInfo vmstate_info_uint32 = {
     .name = "uint32",
     .get  = get_uint32,
     .put  = put_uint32,
+    .get_array = get_32bit_array,
+    .put_array = put_32bit_array,
 };
 
 /* 32 bit uint. See that the received value is the same than the one
@@ -311,6 +485,8 @@ const VMStateInfo vmstate_info_uint64 = {
     .name = "uint64",
     .get  = get_uint64,
     .put  = put_uint64,
+    .get_array = get_64bit_array,
+    .put_array = put_64bit_array,
 };
 
 static int get_nullptr(QEMUFile *f, void *pv, size_t size,
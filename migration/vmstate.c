@@ -75,6 +75,48 @@ static void vmstate_handle_alloc(void *ptr, const VMStateField *field,
     }
 }
 
+static bool vmsd_can_compress(const VMStateField *field)
+{
+    if (field->field_exists) {
+        /* Dynamically existing fields mess up compression */
+        return false;
+    }
+
+    if (field->flags & VMS_STRUCT) {
+        const VMStateField *sfield = field->vmsd->fields;
+        while (sfield->name) {
+            if (!vmsd_can_compress(sfield)) {
+                /* Child elements can't compress, so can't we */
+                return false;
+            }
+            sfield++;
+        }
+
+        if (field->vmsd->subsections) {
+            /* Subsections may come and go, better don't compress */
+            return false;
+        }
+    }
+
+    return true;
+}
+
+/*
+ * Whether the @n_elems elements of @field can be transferred with a
+ * single get_array/put_array call rather than one callback per element.
+ * Fields that the vmdesc describes element by element are not, so that
+ * the description stays the same.
+ */
+static bool vmstate_field_is_bulk(const VMStateField *field, int n_elems,
+                                  bool save)
+{
+    if (n_elems < 2 || !vmsd_can_compress(field) ||
+        field->flags & (VMS_STRUCT | VMS_VSTRUCT | VMS_ARRAY_OF_POINTER)) {
+        return false;
+    }
+    return save ? field->info->put_array : field->info->get_array;
+}
+
 int vmstate_load_state(QEMUFile *f, const VMStateDescription *vmsd,
                        void *opaque, int version_id)
 {
@@ -117,6 +159,7 @@ int vmstate_load_state(QEMUFile *f, const VMStateDescription *vmsd,
             void *first_elem = opaque + field->offset;
             int i, n_elems = vmstate_n_elems(opaque, field);
             int size = vmstate_size(opaque, field);
+            bool bulk = vmstate_field_is_bulk(field, n_elems, false);
 
             vmstate_handle_alloc(first_elem, field, opaque);
             if (field->flags & VMS_POINTER) {
@@ -139,6 +182,8 @@ int vmstate_load_state(QEMUFile *f, const VMStateDescription *vmsd,
                 } else if (field->flags & VMS_VSTRUCT) {
                     ret = vmstate_load_state(f, field->vmsd, curr_elem,
                                              field->struct_version_id);
+                } else if (bulk) {
+                    ret = field->info->get_array(f, curr_elem, size, n_elems);
                 } else {
                     ret = field->info->get(f, curr_elem, size, field);
                 }
@@ -152,6 +197,10 @@ int vmstate_load_state(QEMUFile *f, const VMStateDescription *vmsd,
                     trace_vmstate_load_field_error(field->name, ret);
                     return ret;
                 }
+                if (bulk) {
+                    /* The whole array was loaded at once */
+                    break;
+                }
             }
         } else if (field->flags & VMS_MUST_EXIST) {
             error_report("Input validation failed: %s/%s",
@@ -223,32 +272,6 @@ static const char *vmfield_get_type_name(const VMStateField *field)
     return type;
 }
 
-static bool vmsd_can_compress(const VMStateField *field)
-{
-    if (field->field_exists) {
-        /* Dynamically existing fields mess up compression */
-        return false;
-    }
-
-    if (field->flags & VMS_STRUCT) {
-        const VMStateField *sfield = field->vmsd->fields;
-        while (sfield->name) {
-            if (!vmsd_can_compress(sfield)) {
-                /* Child elements can't compress, so can't we */
-                return false;
-            }
-            sfield++;
-        }
-
-        if (field->vmsd->subsections) {
-            /* Subsections may come and go, better don't compress */
-            return false;
-        }
-    }
-
-    return true;
-}
-
 static void vmsd_desc_field_start(const VMStateDescription *vmsd,
                                   JSONWriter *vmdesc,
                                   const VMStateField *field, int i, int max)
@@ -356,6 +379,7 @@ int vmstate_save_state_v(QEMUFile *f, const VMStateDescription *vmsd,
             int size = vmstate_size(opaque, field);
             int64_t old_offset, written_bytes;
             JSONWriter *vmdesc_loop = vmdesc;
+            bool bulk = vmstate_field_is_bulk(field, n_elems, true);
 
             trace_vmstate_save_state_loop(vmsd->name, field->name, n_elems);
             if (field->flags & VMS_POINTER) {
@@ -383,6 +407,8 @@ int vmstate_save_state_v(QEMUFile *f, const VMStateDescription *vmsd,
                     ret = vmstate_save_state_v(f, field->vmsd, curr_elem,
                                                vmdesc_loop,
                                                field->struct_version_id);
+                } else if (bulk) {
+                    ret = field->info->put_array(f, curr_elem, size, n_elems);
                 } else {
                     ret = field->info->put(f, curr_elem, size, field,
                                      vmdesc_loop);
@@ -397,12 +423,20 @@ int vmstate_save_state_v(QEMUFile *f, const VMStateDescription *vmsd,
                 }
 
                 written_bytes = qemu_ftell_fast(f) - old_offset;
+                if (bulk) {
+                    /* Describe the array as its first element, as below */
+                    written_bytes /= n_elems;
+                }
                 vmsd_desc_field_end(vmsd, vmdesc_loop, field, written_bytes, i);
 
                 /* Compressed arrays only care about the first element */
                 if (vmdesc_loop && vmsd_can_compress(field)) {
                     vmdesc_loop = NULL;
                 }
+                if (bulk) {
+                    /* The whole array was saved at once */
+                    break;
+                }
             }
         } else {
             if (field->flags & VMS_MUST_EXIST) {
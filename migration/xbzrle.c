@@ -12,6 +12,7 @@
  */
 #include "qemu/osdep.h"
 #include "qemu/cutils.h"
+#include "qemu/host-utils.h"
 #include "xbzrle.h"
 
 /*
@@ -24,8 +25,8 @@
 
   length = uleb128 encoded integer
  */
-int xbzrle_encode_buffer(uint8_t *old_buf, uint8_t *new_buf, int slen,
-                         uint8_t *dst, int dlen)
+static int xbzrle_encode_buffer_int(uint8_t *old_buf, uint8_t *new_buf,
+                                    int slen, uint8_t *dst, int dlen)
 {
     uint32_t zrun_len = 0, nzrun_len = 0;
     int d = 0, i = 0;
@@ -126,6 +127,152 @@ int xbzrle_encode_buffer(uint8_t *old_buf, uint8_t *new_buf, int slen,
     return d;
 }
 
+#ifdef CONFIG_AVX2_OPT
+#pragma GCC push_options
+#pragma GCC target("avx2")
+#include <immintrin.h>
+
+/*
+ * Return the offset of the first byte at or after @i for which "old and
+ * new are equal" is not @eq, or @slen if there is none.  32 bytes are
+ * compared at a time and the run end is found with a single ctz; the
+ * first few bytes are checked one by one because very short runs are
+ * common in heavily fragmented pages.
+ */
+static inline int xbzrle_run_end_avx2(uint8_t *old_buf, uint8_t *new_buf,
+                                      int i, int slen, bool eq)
+{
+    int end = MIN(i + 4, slen);
+
+    for (; i < end; i++) {
+        if ((old_buf[i] == new_buf[i]) != eq) {
+            return i;
+        }
+    }
+
+    while (i + 32 <= slen) {
+        __m256i o = _mm256_loadu_si256((__m256i *)(old_buf + i));
+        __m256i n = _mm256_loadu_si256((__m256i *)(new_buf + i));
+        uint32_t same = _mm256_movemask_epi8(_mm256_cmpeq_epi8(o, n));
+        uint32_t run = eq ? same : ~same;
+
+        if (run != UINT32_MAX) {
+            return i + ctz32(~run);
+        }
+        i += 32;
+    }
+
+    while (i < slen && (old_buf[i] == new_buf[i]) == eq) {
+        i++;
+    }
+    return i;
+}
+
+/*
+ * Same output as xbzrle_encode_buffer_int(), including where overflow
+ * is detected, so the two can be used interchangeably.
+ */
+static int xbzrle_encode_buffer_avx2(uint8_t *old_buf, uint8_t *new_buf,
+                                     int slen, uint8_t *dst, int dlen)
+{
+    int d = 0, i = 0, end;
+    uint32_t zrun_len, nzrun_len;
+
+    while (i < slen) {
+        /* overflow */
+        if (d + 2 > dlen) {
+            return -1;
+        }
+
+        end = xbzrle_run_end_avx2(old_buf, new_buf, i, slen, true);
+        zrun_len = end - i;
+        i = end;
+
+        /* buffer unchanged */
+        if (zrun_len == slen) {
+            return 0;
+        }
+
+        /* skip last zero run */
+        if (i == slen) {
+            return d;
+        }
+
+        d += uleb128_encode_small(dst + d, zrun_len);
+
+        /* overflow */
+        if (d + 2 > dlen) {
+            return -1;
+        }
+
+        end = xbzrle_run_end_avx2(old_buf, new_buf, i, slen, false);
+        nzrun_len = end - i;
+
+        d += uleb128_encode_small(dst + d, nzrun_len);
+        /* overflow */
+        if (d + nzrun_len > dlen) {
+            return -1;
+        }
+        memcpy(dst + d, new_buf + i, nzrun_len);
+        d += nzrun_len;
+        i = end;
+    }
+
+    return d;
+}
+#pragma GCC pop_options
+#endif /* CONFIG_AVX2_OPT */
+
+typedef int (*XbzrleEncodeFn)(uint8_t *old_buf, uint8_t *new_buf, int slen,
+                              uint8_t *dst, int dlen);
+
+static XbzrleEncodeFn xbzrle_encode_best = xbzrle_encode_buffer_int;
+static XbzrleEncodeFn xbzrle_encode_accel = xbzrle_encode_buffer_int;
+
+#ifdef CONFIG_AVX2_OPT
+#include "qemu/cpuid.h"
+
+static void __attribute__((constructor)) xbzrle_init_accel(void)
+{
+    unsigned max = __get_cpuid_max(0, NULL);
+    int a, b, c, d;
+
+    if (max < 7) {
+        return;
+    }
+
+    __cpuid(1, a, b, c, d);
+
+    /* We must check that AVX is not just available, but usable.  */
+    if ((c & bit_OSXSAVE) && (c & bit_AVX)) {
+        int bv;
+        __asm("xgetbv" : "=a"(bv), "=d"(d) : "c"(0));
+        __cpuid_count(7, 0, a, b, c, d);
+        if ((bv & 0x6) == 0x6 && (b & bit_AVX2)) {
+            xbzrle_encode_best = xbzrle_encode_buffer_avx2;
+            xbzrle_encode_accel = xbzrle_encode_buffer_avx2;
+        }
+    }
+}
+#endif /* CONFIG_AVX2_OPT */
+
+bool test_xbzrle_encode_next_accel(void)
+{
+    if (xbzrle_encode_accel == xbzrle_encode_buffer_int) {
+        /* All tried; start over from the fastest for the next caller.  */
+        xbzrle_encode_accel = xbzrle_encode_best;
+        return false;
+    }
+    xbzrle_encode_accel = xbzrle_encode_buffer_int;
+    return true;
+}
+
+int xbzrle_encode_buffer(uint8_t *old_buf, uint8_t *new_buf, int slen,
+                         uint8_t *dst, int dlen)
+{
+    return xbzrle_encode_accel(old_buf, new_buf, slen, dst, dlen);
+}
+
 int xbzrle_decode_buffer(uint8_t *src, int slen, uint8_t *dst, int dlen)
 {
     int i = 0, d = 0;
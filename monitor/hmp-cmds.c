@@ -305,6 +305,10 @@ void hmp_info_migrate(Monitor *mon, const QDict *qdict)
             monitor_printf(mon, "postcopy ram: %" PRIu64 " kbytes\n",
                            info->ram->postcopy_bytes >> 10);
         }
+        if (info->ram->dedup_pages) {
+            monitor_printf(mon, "dedup: %" PRIu64 " pages\n",
+                           info->ram->dedup_pages);
+        }
     }
 
     if (info->has_disk) {
@@ -346,6 +350,23 @@ void hmp_info_migrate(Monitor *mon, const QDict *qdict)
                        info->compression->compression_rate);
     }
 
+    if (info->has_multifd_channels) {
+        MultiFDChannelStatsList *item;
+
+        for (item = info->multifd_channels; item; item = item->next) {
+            MultiFDChannelStats *stats = item->value;
+
+            monitor_printf(mon, "multifd channel %u: %" PRIu64 " packets, "
+                           "%" PRIu64 " normal pages, %" PRIu64 " zero pages, "
+                           "compressed %" PRIu64 " kbytes (rate %0.2f), "
+                           "prepare %" PRIu64 " ms\n",
+                           stats->id, stats->packets, stats->normal_pages,
+                           stats->zero_pages, stats->compressed_size >> 10,
+                           stats->compression_rate,
+                           stats->prepare_time / SCALE_MS);
+        }
+    }
+
     if (info->has_cpu_throttle_percentage) {
         monitor_printf(mon, "cpu throttle percentage: %" PRIu64 "\n",
                        info->cpu_throttle_percentage);
@@ -367,6 +388,23 @@ void hmp_info_migrate(Monitor *mon, const QDict *qdict)
         g_free(str);
         visit_free(v);
     }
+    if (info->has_postcopy_latency) {
+        monitor_printf(mon, "postcopy request latency: %" PRIu64 " ns\n",
+                       info->postcopy_latency);
+    }
+
+    if (info->has_postcopy_latency_dist) {
+        Visitor *v;
+        char *str;
+        v = string_output_visitor_new(false, &str);
+        visit_type_uint64List(v, NULL, &info->postcopy_latency_dist,
+                              &error_abort);
+        visit_complete(v, &str);
+        monitor_printf(mon, "postcopy request latency dist (log2 us): %s\n",
+                       str);
+        g_free(str);
+        visit_free(v);
+    }
     if (info->has_socket_address) {
         SocketAddressList *addr;
 
@@ -1850,6 +1888,12 @@ void hmp_info_iothreads(Monitor *mon, const QDict *qdict)
         monitor_printf(mon, "  poll-shrink=%" PRId64 "\n", value->poll_shrink);
         monitor_printf(mon, "  aio-max-batch=%" PRId64 "\n",
                        value->aio_max_batch);
+        monitor_printf(mon, "  poll-hit-target=%" PRId64 "\n",
+                       value->poll_hit_target);
+        monitor_printf(mon, "  poll-hits=%" PRIu64 "\n", value->poll_hits);
+        monitor_printf(mon, "  poll-misses=%" PRIu64 "\n", value->poll_misses);
+        monitor_printf(mon, "  poll-wasted-ns=%" PRIu64 "\n",
+                       value->poll_wasted_ns);
     }
 
     qapi_free_IOThreadInfoList(info_list);
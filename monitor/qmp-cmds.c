@@ -17,6 +17,7 @@
 #include "qemu-common.h"
 #include "qemu/cutils.h"
 #include "qemu/option.h"
+#include "qemu/thread.h"
 #include "monitor/monitor.h"
 #include "sysemu/sysemu.h"
 #include "qemu/config-file.h"
@@ -75,6 +76,70 @@ UuidInfo *qmp_query_uuid(Error **errp)
     return info;
 }
 
+static void add_sync_profile_entry(const QSPReportEntry *e, void *opaque)
+{
+    SyncProfileEntryList ***tail = opaque;
+    SyncProfileEntry *entry = g_new0(SyncProfileEntry, 1);
+    uint64List **hist_tail = &entry->histogram;
+    int i;
+
+    entry->type = g_strdup(e->typename);
+    entry->callsite = g_strdup(e->callsite_at);
+    entry->objects = MAX(e->n_objs, 1);
+    entry->wait_ns = e->time_s * 1e9;
+    entry->count = e->n_acqs;
+    for (i = 0; i < QSP_HIST_BUCKETS; i++) {
+        QAPI_LIST_APPEND(hist_tail, e->hist[i]);
+    }
+    QAPI_LIST_APPEND(*tail, entry);
+}
+
+SyncProfileEntryList *qmp_x_query_sync_profile(bool has_max, uint32_t max,
+                                               bool has_sort_by_average,
+                                               bool sort_by_average,
+                                               bool has_coalesce,
+                                               bool coalesce, Error **errp)
+{
+    SyncProfileEntryList *head = NULL;
+    SyncProfileEntryList **tail = &head;
+    enum QSPSortBy sort_by = QSP_SORT_BY_TOTAL_WAIT_TIME;
+
+    if (has_sort_by_average && sort_by_average) {
+        sort_by = QSP_SORT_BY_AVG_WAIT_TIME;
+    }
+    qsp_report_iter(has_max ? max : 10, sort_by,
+                    has_coalesce ? coalesce : true,
+                    add_sync_profile_entry, &tail);
+    return head;
+}
+
+void qmp_x_sync_profile(bool enable, bool has_reset, bool reset,
+                        bool has_sample_period, uint32_t sample_period,
+                        bool has_contended_only, bool contended_only,
+                        Error **errp)
+{
+    unsigned int period;
+    bool only_contended;
+
+    if (has_sample_period && sample_period == 0) {
+        error_setg(errp, "sample-period must be at least 1");
+        return;
+    }
+
+    /* Omitted settings keep their current value */
+    qsp_get_sampling(&period, &only_contended);
+    qsp_set_sampling(has_sample_period ? sample_period : period,
+                     has_contended_only ? contended_only : only_contended);
+    if (has_reset && reset) {
+        qsp_reset();
+    }
+    if (enable) {
+        qsp_enable();
+    } else {
+        qsp_disable();
+    }
+}
+
 void qmp_quit(Error **errp)
 {
     shutdown_action = SHUTDOWN_ACTION_POWEROFF;
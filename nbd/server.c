@@ -39,6 +39,21 @@
  */
 #define NBD_MAX_BLOCK_STATUS_EXTENTS (1 * MiB / 8)
 
+/*
+ * Request payload buffers are kept per client for reuse, so that large
+ * requests do not mmap and fault in a fresh buffer every time.  Buffer
+ * sizes are rounded up to a power of two, starting at NBD_BUF_MIN_SIZE.
+ *
+ * Read replies are not sent with QIO_CHANNEL_WRITE_FLAG_ZERO_COPY: a
+ * buffer could only go back to the cache after qio_channel_flush(), which
+ * waits for the completions with qio_channel_wait() and would stall the
+ * export's AioContext from the request coroutine.  Accepted sockets do
+ * not enable SO_ZEROCOPY either, and TLS clients cannot use it at all.
+ */
+#define NBD_BUF_MIN_SIZE (4 * KiB)
+#define NBD_BUF_CACHE_COUNT 16
+#define NBD_BUF_CACHE_MAX_BYTES (32 * MiB)
+
 static int system_errno_to_nbd_errno(int err)
 {
     switch (err) {
@@ -79,9 +94,15 @@ typedef struct NBDRequestData NBDRequestData;
 struct NBDRequestData {
     NBDClient *client;
     uint8_t *data;
+    size_t data_size;
     bool complete;
 };
 
+typedef struct NBDBuffer {
+    void *buf;
+    size_t size;
+} NBDBuffer;
+
 struct NBDExport {
     BlockExport common;
 
@@ -146,6 +167,10 @@ struct NBDClient {
     uint32_t opt; /* Current option being negotiated */
     uint32_t optlen; /* remaining length of data in ioc for the option being
                         negotiated now */
+
+    NBDBuffer buf_cache[NBD_BUF_CACHE_COUNT];
+    int buf_cache_count;
+    size_t buf_cache_bytes;
 };
 
 static void nbd_client_receive_next_request(NBDClient *client);
@@ -1469,6 +1494,9 @@ void nbd_client_put(NBDClient *client)
             object_unref(OBJECT(client->tlscreds));
         }
         g_free(client->tlsauthz);
+        while (client->buf_cache_count) {
+            qemu_vfree(client->buf_cache[--client->buf_cache_count].buf);
+        }
         if (client->exp) {
             QTAILQ_REMOVE(&client->exp->clients, client, next);
             blk_exp_unref(&client->exp->common);
@@ -1498,6 +1526,41 @@ static void client_close(NBDClient *client, bool negotiated)
     }
 }
 
+static void *nbd_buffer_get(NBDClient *client, size_t len, size_t *size)
+{
+    int i;
+
+    *size = pow2ceil(MAX(len, NBD_BUF_MIN_SIZE));
+    for (i = 0; i < client->buf_cache_count; i++) {
+        NBDBuffer *b = &client->buf_cache[i];
+        void *buf = b->buf;
+
+        if (b->size == *size) {
+            client->buf_cache_bytes -= b->size;
+            *b = client->buf_cache[--client->buf_cache_count];
+            return buf;
+        }
+    }
+
+    return blk_try_blockalign(client->exp->common.blk, *size);
+}
+
+static void nbd_buffer_put(NBDClient *client, void *buf, size_t size)
+{
+    if (!client->closing &&
+        client->buf_cache_count < NBD_BUF_CACHE_COUNT &&
+        client->buf_cache_bytes + size <= NBD_BUF_CACHE_MAX_BYTES) {
+        client->buf_cache[client->buf_cache_count++] = (NBDBuffer) {
+            .buf = buf,
+            .size = size,
+        };
+        client->buf_cache_bytes += size;
+        return;
+    }
+
+    qemu_vfree(buf);
+}
+
 static NBDRequestData *nbd_request_get(NBDClient *client)
 {
     NBDRequestData *req;
@@ -1516,7 +1579,7 @@ static void nbd_request_put(NBDRequestData *req)
     NBDClient *client = req->client;
 
     if (req->data) {
-        qemu_vfree(req->data);
+        nbd_buffer_put(client, req->data, req->data_size);
     }
     g_free(req);
 
@@ -1641,7 +1704,7 @@ static int nbd_export_create(BlockExport *blk_exp, BlockExportOptions *exp_args,
     int64_t size;
     uint64_t perm, shared_perm;
     bool readonly = !exp_args->writable;
-    bool shared = !exp_args->writable;
+    bool multi_conn;
     strList *bitmaps;
     size_t i;
     int ret;
@@ -1694,13 +1757,23 @@ static int nbd_export_create(BlockExport *blk_exp, BlockExportOptions *exp_args,
                      NBD_FLAG_SEND_FUA | NBD_FLAG_SEND_CACHE);
     if (readonly) {
         exp->nbdflags |= NBD_FLAG_READ_ONLY;
-        if (shared) {
-            exp->nbdflags |= NBD_FLAG_CAN_MULTI_CONN;
-        }
     } else {
         exp->nbdflags |= (NBD_FLAG_SEND_TRIM | NBD_FLAG_SEND_WRITE_ZEROES |
                           NBD_FLAG_SEND_FAST_ZERO);
     }
+
+    /*
+     * All connections go through the same BlockBackend, so a flush on one
+     * of them also flushes the writes made on the others.
+     */
+    if (!arg->has_multi_conn) {
+        arg->multi_conn = ON_OFF_AUTO_AUTO;
+    }
+    multi_conn = arg->multi_conn == ON_OFF_AUTO_ON ||
+                 (arg->multi_conn == ON_OFF_AUTO_AUTO && readonly);
+    if (multi_conn) {
+        exp->nbdflags |= NBD_FLAG_CAN_MULTI_CONN;
+    }
     exp->size = QEMU_ALIGN_DOWN(size, BDRV_SECTOR_SIZE);
 
     for (bitmaps = arg->bitmaps; bitmaps; bitmaps = bitmaps->next) {
@@ -2314,8 +2387,8 @@ static int nbd_co_receive_request(NBDRequestData *req, NBDRequest *request,
         }
 
         if (request->type != NBD_CMD_CACHE) {
-            req->data = blk_try_blockalign(client->exp->common.blk,
-                                           request->len);
+            req->data = nbd_buffer_get(client, request->len,
+                                       &req->data_size);
             if (req->data == NULL) {
                 error_setg(errp, "No memory");
                 return -ENOMEM;
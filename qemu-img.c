@@ -47,6 +47,7 @@
 #include "block/block_int.h"
 #include "block/blockjob.h"
 #include "block/qapi.h"
+#include "block/thread-pool.h"
 #include "crypto/init.h"
 #include "trace/control.h"
 #include "qemu/throttle.h"
@@ -83,6 +84,7 @@ enum {
     OPTION_BITMAPS = 275,
     OPTION_FORCE = 276,
     OPTION_SKIP_BROKEN = 277,
+    OPTION_DEDUP_BACKING = 278,
 };
 
 typedef enum OutputFormat {
@@ -1651,6 +1653,7 @@ typedef struct ImgConvertState {
     enum ImgConvertBlockStatus status;
     int64_t sector_next_status;
     BlockBackend *target;
+    BlockBackend *target_backing; /* only for --dedup-backing */
     bool has_zero_init;
     bool compressed;
     bool target_is_new;
@@ -1843,47 +1846,151 @@ static int coroutine_fn convert_co_read(ImgConvertState *s, int64_t sector_num,
     return 0;
 }
 
+/*
+ * Zero detection for a buffer that is about to be written.  It runs in a
+ * worker thread, so that scanning the buffers of several coroutines can use
+ * more than one CPU and overlaps with their I/O.
+ *
+ * With --dedup-backing, clusters that are identical to the target's backing
+ * file are also found, so that they can be left unallocated.
+ */
+typedef struct ConvertRun {
+    int nb_sectors;
+    enum ImgConvertBlockStatus status;
+} ConvertRun;
+
+typedef struct ConvertScan {
+    ImgConvertState *s;
+    const uint8_t *buf;
+    const uint8_t *backing_buf; /* NULL if not comparing with the backing */
+    int64_t sector_num;
+    int nb_sectors;
+    ConvertRun *runs;
+    int nb_runs;
+} ConvertScan;
+
+static void convert_scan_add_run(ConvertScan *scan, int n,
+                                 enum ImgConvertBlockStatus status)
+{
+    if (scan->nb_runs && scan->runs[scan->nb_runs - 1].status == status) {
+        scan->runs[scan->nb_runs - 1].nb_sectors += n;
+    } else {
+        scan->runs[scan->nb_runs++] = (ConvertRun) { n, status };
+    }
+}
+
+/*
+ * Return the number of sectors at the start of the buffer, in whole target
+ * clusters, for which the comparison with the backing file yields @equal.
+ */
+static int convert_scan_backing(ConvertScan *scan, int offset, bool equal)
+{
+    ImgConvertState *s = scan->s;
+    int64_t sector_num = scan->sector_num + offset;
+    int n = 0;
+
+    while (offset + n < scan->nb_sectors) {
+        int chunk = s->cluster_sectors -
+                    (sector_num + n) % s->cluster_sectors;
+        size_t pos = (size_t)(offset + n) * BDRV_SECTOR_SIZE;
+
+        chunk = MIN(chunk, scan->nb_sectors - offset - n);
+        if ((memcmp(scan->buf + pos, scan->backing_buf + pos,
+                    chunk * BDRV_SECTOR_SIZE) == 0) != equal) {
+            break;
+        }
+        n += chunk;
+    }
+
+    return n;
+}
+
+static int convert_scan_worker(void *opaque)
+{
+    ConvertScan *scan = opaque;
+    ImgConvertState *s = scan->s;
+    int offset = 0;
+
+    scan->nb_runs = 0;
+    while (offset < scan->nb_sectors) {
+        int end = scan->nb_sectors;
+
+        if (scan->backing_buf) {
+            int n = convert_scan_backing(scan, offset, true);
+            if (n) {
+                convert_scan_add_run(scan, n, BLK_BACKING_FILE);
+                offset += n;
+                continue;
+            }
+            end = offset + convert_scan_backing(scan, offset, false);
+        }
+
+        while (offset < end) {
+            const uint8_t *buf = scan->buf + offset * BDRV_SECTOR_SIZE;
+            int n = end - offset;
+            bool allocated;
+
+            /*
+             * Compressed clusters need to be written as a whole, so in that
+             * case we can only save the write if the buffer is completely
+             * zeroed.
+             */
+            if (s->compressed) {
+                allocated = !buffer_is_zero(buf, n * BDRV_SECTOR_SIZE);
+            } else {
+                allocated = is_allocated_sectors_min(buf, n, &n, s->min_sparse,
+                                                     scan->sector_num + offset,
+                                                     s->alignment);
+            }
+            convert_scan_add_run(scan, n, allocated ? BLK_DATA : BLK_ZERO);
+            offset += n;
+        }
+    }
+
+    return 0;
+}
 
 static int coroutine_fn convert_co_write(ImgConvertState *s, int64_t sector_num,
                                          int nb_sectors, uint8_t *buf,
-                                         enum ImgConvertBlockStatus status)
+                                         enum ImgConvertBlockStatus status,
+                                         const ConvertScan *scan)
 {
     int ret;
+    int run = 0;
 
     while (nb_sectors > 0) {
         int n = nb_sectors;
+        enum ImgConvertBlockStatus run_status = status;
         BdrvRequestFlags flags = s->compressed ? BDRV_REQ_WRITE_COMPRESSED : 0;
 
-        switch (status) {
+        /*
+         * If we're told to keep the target fully allocated (-S 0), we must
+         * write all data. Otherwise convert_scan_worker() has split the
+         * buffer into runs of real data and of sectors that we can treat
+         * as zero or as unchanged from the backing file.
+         */
+        if (status == BLK_DATA && s->min_sparse) {
+            assert(scan && run < scan->nb_runs);
+            n = scan->runs[run].nb_sectors;
+            run_status = scan->runs[run++].status;
+        }
+
+        switch (run_status) {
         case BLK_BACKING_FILE:
             /* If we have a backing file, leave clusters unallocated that are
-             * unallocated in the source image, so that the backing file is
-             * visible at the respective offset. */
+             * unallocated in the source image or identical to the backing
+             * file, so that the backing file is visible at the respective
+             * offset. */
             assert(s->target_has_backing);
             break;
 
         case BLK_DATA:
-            /* If we're told to keep the target fully allocated (-S 0) or there
-             * is real non-zero data, we must write it. Otherwise we can treat
-             * it as zero sectors.
-             * Compressed clusters need to be written as a whole, so in that
-             * case we can only save the write if the buffer is completely
-             * zeroed. */
-            if (!s->min_sparse ||
-                (!s->compressed &&
-                 is_allocated_sectors_min(buf, n, &n, s->min_sparse,
-                                          sector_num, s->alignment)) ||
-                (s->compressed &&
-                 !buffer_is_zero(buf, n * BDRV_SECTOR_SIZE)))
-            {
-                ret = blk_co_pwrite(s->target, sector_num << BDRV_SECTOR_BITS,
-                                    n << BDRV_SECTOR_BITS, buf, flags);
-                if (ret < 0) {
-                    return ret;
-                }
-                break;
+            ret = blk_co_pwrite(s->target, sector_num << BDRV_SECTOR_BITS,
+                                n << BDRV_SECTOR_BITS, buf, flags);
+            if (ret < 0) {
+                return ret;
             }
-            /* fall-through */
+            break;
 
         case BLK_ZERO:
             if (s->has_zero_init) {
@@ -1943,6 +2050,9 @@ static void coroutine_fn convert_co_do_copy(void *opaque)
 {
     ImgConvertState *s = opaque;
     uint8_t *buf = NULL;
+    ThreadPool *pool = aio_get_thread_pool(blk_get_aio_context(s->target));
+    uint8_t *backing_buf = NULL;
+    ConvertScan scan = { .s = s };
     int ret, i;
     int index = -1;
 
@@ -1956,6 +2066,12 @@ static void coroutine_fn convert_co_do_copy(void *opaque)
 
     s->running_coroutines++;
     buf = blk_blockalign(s->target, s->buf_sectors * BDRV_SECTOR_SIZE);
+    scan.buf = buf;
+    scan.runs = g_new(ConvertRun, s->buf_sectors);
+    if (s->target_backing) {
+        backing_buf = blk_blockalign(s->target_backing,
+                                     s->buf_sectors * BDRV_SECTOR_SIZE);
+    }
 
     while (1) {
         int n;
@@ -1999,6 +2115,26 @@ retry:
                 error_report("error while reading at byte %lld: %s",
                              sector_num * BDRV_SECTOR_SIZE, strerror(-ret));
                 s->ret = ret;
+            } else if (s->min_sparse) {
+                scan.sector_num = sector_num;
+                scan.nb_sectors = n;
+                scan.backing_buf = NULL;
+                if (backing_buf && sector_num < s->target_backing_sectors) {
+                    int64_t offset = sector_num << BDRV_SECTOR_BITS;
+
+                    ret = blk_co_pread(s->target_backing, offset,
+                                       n << BDRV_SECTOR_BITS, backing_buf, 0);
+                    if (ret < 0) {
+                        error_report("error while reading backing file at "
+                                     "byte %" PRId64 ": %s", offset,
+                                     strerror(-ret));
+                        s->ret = ret;
+                    } else {
+                        scan.backing_buf = backing_buf;
+                    }
+                }
+                /* Look for zeroes before waiting for our turn to write */
+                thread_pool_submit_co(pool, convert_scan_worker, &scan);
             }
         } else if (!s->min_sparse && status == BLK_ZERO) {
             status = BLK_DATA;
@@ -2022,7 +2158,7 @@ retry:
                     goto retry;
                 }
             } else {
-                ret = convert_co_write(s, sector_num, n, buf, status);
+                ret = convert_co_write(s, sector_num, n, buf, status, &scan);
             }
             if (ret < 0) {
                 error_report("error while writing at byte %lld: %s",
@@ -2049,6 +2185,8 @@ retry:
         }
     }
 
+    g_free(scan.runs);
+    qemu_vfree(backing_buf);
     qemu_vfree(buf);
     s->co[index] = NULL;
     s->running_coroutines--;
@@ -2215,6 +2353,7 @@ static int img_convert(int argc, char **argv)
     bool explict_min_sparse = false;
     bool bitmaps = false;
     bool skip_broken = false;
+    bool dedup_backing = false;
     int64_t rate_limit = 0;
 
     ImgConvertState s = (ImgConvertState) {
@@ -2237,6 +2376,7 @@ static int img_convert(int argc, char **argv)
             {"target-is-zero", no_argument, 0, OPTION_TARGET_IS_ZERO},
             {"bitmaps", no_argument, 0, OPTION_BITMAPS},
             {"skip-broken-bitmaps", no_argument, 0, OPTION_SKIP_BROKEN},
+            {"dedup-backing", no_argument, 0, OPTION_DEDUP_BACKING},
             {0, 0, 0, 0}
         };
         c = getopt_long(argc, argv, ":hf:O:B:CcF:o:l:S:pt:T:qnm:WUr:",
@@ -2371,6 +2511,9 @@ static int img_convert(int argc, char **argv)
         case OPTION_SKIP_BROKEN:
             skip_broken = true;
             break;
+        case OPTION_DEDUP_BACKING:
+            dedup_backing = true;
+            break;
         }
     }
 
@@ -2398,6 +2541,17 @@ static int img_convert(int argc, char **argv)
         goto fail_getopt;
     }
 
+    if (dedup_backing && s.copy_range) {
+        error_report("Cannot enable copy offloading when --dedup-backing "
+                     "is used");
+        goto fail_getopt;
+    }
+
+    if (dedup_backing && !s.min_sparse) {
+        error_report("Cannot use --dedup-backing when -S 0 is used");
+        goto fail_getopt;
+    }
+
     if (tgt_image_opts && !skip_create) {
         error_report("--target-image-opts requires use of -n flag");
         goto fail_getopt;
@@ -2739,6 +2893,29 @@ static int img_convert(int argc, char **argv)
         s.cluster_sectors = bdi.cluster_size / BDRV_SECTOR_SIZE;
     }
 
+    if (dedup_backing) {
+        if (s.target_backing_sectors < 0) {
+            error_report("--dedup-backing requires a new target image "
+                         "with a backing file (-B)");
+            ret = -1;
+            goto out;
+        }
+        if (s.cluster_sectors <= 0) {
+            error_report("--dedup-backing requires a target format with "
+                         "clusters");
+            ret = -1;
+            goto out;
+        }
+        s.target_backing = blk_new_with_bs(bdrv_backing_chain_next(out_bs),
+                                           BLK_PERM_CONSISTENT_READ,
+                                           BLK_PERM_ALL, &local_err);
+        if (!s.target_backing) {
+            error_reportf_err(local_err, "Could not use backing file: ");
+            ret = -1;
+            goto out;
+        }
+    }
+
     if (rate_limit) {
         set_rate_limit(s.target, rate_limit);
     }
@@ -2758,6 +2935,7 @@ out:
     qemu_opts_del(opts);
     qemu_opts_free(create_opts);
     qobject_unref(open_opts);
+    blk_unref(s.target_backing);
     blk_unref(s.target);
     if (s.src) {
         for (bs_i = 0; bs_i < s.src_num; bs_i++) {
@@ -4318,6 +4496,8 @@ static void bench_cb(void *opaque, int ret)
         }
     }
 
+    /* Submit the new requests together, as a device draining its queue */
+    blk_io_plug(b->blk);
     while (b->n > b->in_flight && b->in_flight < b->nrreq) {
         int64_t offset = b->offset;
         /* blk_aio_* might look for completed I/Os and kick bench_cb
@@ -4337,6 +4517,7 @@ static void bench_cb(void *opaque, int ret)
             exit(EXIT_FAILURE);
         }
     }
+    blk_io_unplug(b->blk);
 }
 
 static int img_bench(int argc, char **argv)
@@ -1094,6 +1094,9 @@ int main(int argc, char **argv)
             .bitmaps              = bitmaps,
             .has_allocation_depth = alloc_depth,
             .allocation_depth     = alloc_depth,
+            .has_multi_conn       = true,
+            .multi_conn           = shared == 1 ? ON_OFF_AUTO_AUTO
+                                                : ON_OFF_AUTO_ON,
         },
     };
     blk_exp_add(export_opts, &error_fatal);
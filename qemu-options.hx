@@ -5413,7 +5413,7 @@ SRST
 
             CN=laptop.example.com,O=Example Home,L=London,ST=London,C=GB
 
-    ``-object iothread,id=id,poll-max-ns=poll-max-ns,poll-grow=poll-grow,poll-shrink=poll-shrink,aio-max-batch=aio-max-batch``
+    ``-object iothread,id=id,poll-max-ns=poll-max-ns,poll-grow=poll-grow,poll-shrink=poll-shrink,poll-hit-target=poll-hit-target,aio-max-batch=aio-max-batch``
         Creates a dedicated event loop thread that devices can be
         assigned to. This is known as an IOThread. By default device
         emulation happens in vCPU threads or the main event loop thread.
@@ -5449,6 +5449,14 @@ SRST
         the polling time when the algorithm detects it is spending too
         long polling without encountering events.
 
+        The ``poll-hit-target`` parameter replaces the grow/shrink
+        algorithm with one that keeps a histogram of recent event wait
+        times and polls just long enough to catch the given percentage
+        of events. If that would take longer than ``poll-max-ns``,
+        polling is disabled until the workload changes. The
+        ``query-iothreads`` command reports polling hits, misses and
+        the time wasted in polling that found no events.
+
         The ``aio-max-batch`` parameter is the maximum number of requests
         in a batch for the AIO engine, 0 means that the engine will use
         its default.
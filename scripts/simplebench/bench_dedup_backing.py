@@ -0,0 +1,112 @@
+#!/usr/bin/env python3
+#
+# Benchmark qemu-img convert --dedup-backing
+#
+# Converts a flat image into an overlay of a base image, with and without
+# --dedup-backing, and measures how long the conversion takes.  The source
+# should share most of its data with the base, e.g. a flattened copy of an
+# overlay of it.  Divide the virtual size of the source by the result to
+# get the write throughput.
+#
+# This program is free software; you can redistribute it and/or modify
+# it under the terms of the GNU General Public License as published by
+# the Free Software Foundation; either version 2 of the License, or
+# (at your option) any later version.
+#
+# This program is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+# GNU General Public License for more details.
+#
+# You should have received a copy of the GNU General Public License
+# along with this program.  If not, see <http://www.gnu.org/licenses/>.
+#
+
+
+import sys
+import os
+import subprocess
+import time
+import simplebench
+from results_to_text import results_to_text
+
+
+def bench_func(env, case):
+    """ Handle one "cell" of benchmarking table. """
+    return bench_convert(env['qemu_img'], env['base'], env['source'],
+                         env['target'], env['dedup'], case['coroutines'],
+                         case['out_of_order'])
+
+
+def bench_convert(qemu_img, base, source, target, dedup, coroutines,
+                  out_of_order):
+    """Benchmark conversion of a flat qcow2 image into an overlay
+
+    qemu_img     -- path to qemu-img executable file
+    base         -- qcow2 image that becomes the backing file of the target
+    source       -- qcow2 image to convert
+    target       -- path of the new qcow2 image, overwritten
+    dedup        -- whether to pass --dedup-backing
+    coroutines   -- value of the -m option
+    out_of_order -- whether to pass -W
+
+    Returns {'seconds': float} on success and {'error': str} on failure.
+    Return value is compatible with simplebench lib.
+    """
+
+    try:
+        os.remove(target)
+    except OSError:
+        pass
+
+    args = [qemu_img, 'convert', '-f', 'qcow2', '-O', 'qcow2',
+            '-B', os.path.abspath(base), '-F', 'qcow2', '-t', 'none',
+            '-m', str(coroutines)]
+    if out_of_order:
+        args.append('-W')
+    if dedup:
+        args.append('--dedup-backing')
+    args += [source, target]
+
+    start = time.time()
+    p = subprocess.run(args, stdout=subprocess.PIPE,
+                       stderr=subprocess.STDOUT, universal_newlines=True)
+    seconds = time.time() - start
+
+    if p.returncode != 0:
+        return {'error': f'qemu-img convert failed: {p.stdout}'}
+
+    return {'seconds': seconds}
+
+
+if __name__ == '__main__':
+
+    if len(sys.argv) < 5:
+        program = os.path.basename(sys.argv[0])
+        print(f'USAGE: {program} <path to qemu-img binary file> '
+              '<base image> <source image> <target image>')
+        exit(1)
+
+    qemu_img, base, source, target = sys.argv[1:5]
+    for img in (base, source):
+        if not os.path.isfile(img):
+            print(f'File not found: {img}')
+            exit(1)
+
+    # Test-cases are "rows" in benchmark resulting table, 'id' is a caption
+    # for the row, other fields are handled by bench_func.
+    test_cases = [
+        {'id': '-m 8', 'coroutines': 8, 'out_of_order': False},
+        {'id': '-m 8 -W', 'coroutines': 8, 'out_of_order': True},
+        {'id': '-m 16 -W', 'coroutines': 16, 'out_of_order': True},
+    ]
+
+    # Test-envs are "columns" in benchmark resulting table, 'id is a caption
+    # for the column, other fields are handled by bench_func.
+    test_envs = [{'id': '--dedup-backing' if dedup else 'plain',
+                  'qemu_img': qemu_img, 'base': base, 'source': source,
+                  'target': target, 'dedup': dedup}
+                 for dedup in (False, True)]
+
+    result = simplebench.bench(bench_func, test_envs, test_cases, count=3)
+    print(results_to_text(result))
@@ -0,0 +1,99 @@
+#!/usr/bin/env python3
+#
+# Benchmark io_uring submission batching with qemu-img bench
+#
+# Measures the IOPS of 4k reads through the io_uring AIO backend for
+# several queue depths and aio-max-batch values.  aio-max-batch=0 uses the
+# AioContext limit; a second qemu-img binary (e.g. one built before
+# io_uring honoured aio-max-batch) can be given for comparison.
+#
+# This program is free software; you can redistribute it and/or modify
+# it under the terms of the GNU General Public License as published by
+# the Free Software Foundation; either version 2 of the License, or
+# (at your option) any later version.
+#
+# This program is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+# GNU General Public License for more details.
+#
+# You should have received a copy of the GNU General Public License
+# along with this program.  If not, see <http://www.gnu.org/licenses/>.
+#
+
+
+import sys
+import os
+import subprocess
+import simplebench
+from results_to_text import results_to_text
+
+
+REQUEST_COUNT = 1000000
+REQUEST_SIZE = 4096
+
+
+def bench_func(env, case):
+    """ Handle one "cell" of benchmarking table. """
+    return bench_io_uring(env['qemu_img'], env['image_name'],
+                          env['max_batch'], case['depth'])
+
+
+def bench_io_uring(qemu_img, image_name, max_batch, depth):
+    """Benchmark reads through io_uring
+
+    qemu_img   -- path to qemu-img executable file
+    image_name -- existing image file to read from, preferably on a fast
+                  NVMe device
+    max_batch  -- aio-max-batch option of the file driver
+    depth      -- number of requests in flight
+
+    Returns {'iops': float} on success and {'error': str} on failure.
+    Return value is compatible with simplebench lib.
+    """
+
+    opts = (f'driver=file,filename={image_name},aio=io_uring,'
+            f'cache.direct=on,aio-max-batch={max_batch}')
+    args = [qemu_img, 'bench', '--image-opts', '-c', str(REQUEST_COUNT),
+            '-d', str(depth), '-s', str(REQUEST_SIZE), opts]
+
+    p = subprocess.run(args, stdout=subprocess.PIPE,
+                       stderr=subprocess.STDOUT, universal_newlines=True)
+    if p.returncode != 0 or 'seconds' not in p.stdout:
+        return {'error': f'qemu-img bench failed: {p.stdout}'}
+
+    ret_list = p.stdout.split()
+    seconds = float(ret_list[ret_list.index('seconds.') - 1])
+    return {'iops': REQUEST_COUNT / seconds, 'seconds': seconds}
+
+
+if __name__ == '__main__':
+
+    if len(sys.argv) < 3:
+        program = os.path.basename(sys.argv[0])
+        print(f'USAGE: {program} <path to qemu-img binary file> '
+              '<image file to read from> '
+              '[<path to another qemu-img to compare performance with>]')
+        exit(1)
+
+    qemu_img, image_name = sys.argv[1], sys.argv[2]
+    if not os.path.isfile(image_name):
+        print(f'File not found: {image_name}')
+        exit(1)
+
+    # Test-cases are "rows" in benchmark resulting table, 'id' is a caption
+    # for the row, other fields are handled by bench_func.
+    test_cases = [{'id': f'depth {depth}', 'depth': depth}
+                  for depth in (1, 16, 64, 128)]
+
+    # Test-envs are "columns" in benchmark resulting table, 'id is a caption
+    # for the column, other fields are handled by bench_func.
+    test_envs = [{'id': f'aio-max-batch={max_batch}', 'qemu_img': qemu_img,
+                  'image_name': image_name, 'max_batch': max_batch}
+                 for max_batch in (0, 1, 8, 128)]
+    if len(sys.argv) > 3:
+        test_envs.append({'id': 'other qemu-img', 'qemu_img': sys.argv[3],
+                          'image_name': image_name, 'max_batch': 0})
+
+    result = simplebench.bench(bench_func, test_envs, test_cases, count=3)
+    print(results_to_text(result))
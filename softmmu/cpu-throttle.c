@@ -25,6 +25,7 @@
 #include "qemu/osdep.h"
 #include "qemu-common.h"
 #include "qemu/thread.h"
+#include "qemu/rcu.h"
 #include "hw/core/cpu.h"
 #include "qemu/main-loop.h"
 #include "sysemu/cpus.h"
@@ -33,6 +34,7 @@
 /* vcpu throttling controls */
 static QEMUTimer *throttle_timer;
 static unsigned int throttle_percentage;
+static bool throttle_per_vcpu;
 
 #define CPU_THROTTLE_PCT_MIN 1
 #define CPU_THROTTLE_PCT_MAX 99
@@ -40,7 +42,7 @@ static unsigned int throttle_percentage;
 
 static void cpu_throttle_thread(CPUState *cpu, run_on_cpu_data opaque)
 {
-    double pct;
+    double pct, vcpu_pct;
     double throttle_ratio;
     int64_t sleeptime_ns, endtime_ns;
 
@@ -49,9 +51,20 @@ static void cpu_throttle_thread(CPUState *cpu, run_on_cpu_data opaque)
     }
 
     pct = (double)cpu_throttle_get_percentage() / 100;
-    throttle_ratio = pct / (1 - pct);
+    vcpu_pct = pct;
+    if (qatomic_read(&throttle_per_vcpu)) {
+        vcpu_pct = MIN((double)qatomic_read(&cpu->throttle_percentage) / 100,
+                       pct);
+    }
+
+    /*
+     * The timer ticks every CPU_THROTTLE_TIMESLICE_NS / (1 - pct); sleep
+     * for vcpu_pct of that.
+     */
+    throttle_ratio = vcpu_pct / (1 - pct);
     /* Add 1ns to fix double's rounding error (like 0.9999999...) */
-    sleeptime_ns = (int64_t)(throttle_ratio * CPU_THROTTLE_TIMESLICE_NS + 1);
+    sleeptime_ns = vcpu_pct ?
+        (int64_t)(throttle_ratio * CPU_THROTTLE_TIMESLICE_NS + 1) : 0;
     endtime_ns = qemu_clock_get_ns(QEMU_CLOCK_REALTIME) + sleeptime_ns;
     while (sleeptime_ns > 0 && !cpu->stop) {
         if (sleeptime_ns > SCALE_MS) {
@@ -107,9 +120,26 @@ void cpu_throttle_set(int new_throttle_pct)
     }
 }
 
+void cpu_throttle_set_vcpu(CPUState *cpu, int pct)
+{
+    pct = MIN(pct, CPU_THROTTLE_PCT_MAX);
+    pct = MAX(pct, 0);
+
+    qatomic_set(&cpu->throttle_percentage, pct);
+    qatomic_set(&throttle_per_vcpu, true);
+}
+
 void cpu_throttle_stop(void)
 {
+    CPUState *cpu;
+
     qatomic_set(&throttle_percentage, 0);
+    qatomic_set(&throttle_per_vcpu, false);
+    WITH_RCU_READ_LOCK_GUARD() {
+        CPU_FOREACH(cpu) {
+            qatomic_set(&cpu->throttle_percentage, 0);
+        }
+    }
 }
 
 bool cpu_throttle_active(void)
@@ -0,0 +1,119 @@
+/*
+ * QEMU buffer_is_zero speed benchmark
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or
+ * (at your option) any later version.  See the COPYING file in the
+ * top-level directory.
+ */
+#include "qemu/osdep.h"
+#include "qemu/units.h"
+#include "qemu/cutils.h"
+#include "qemu/bitmap.h"
+
+typedef struct BufferIsZeroOpts {
+    size_t chunk_size;
+    unsigned zero_percent;
+} BufferIsZeroOpts;
+
+static const size_t total = 4 * GiB;
+static const size_t buf_size = 64 * MiB;
+
+/*
+ * Fill the buffer so that about @zero_percent of its @chunk_size chunks
+ * are zero.  Non-zero chunks have a single byte set at a random offset,
+ * so that early exit is exercised at varying positions.
+ */
+static uint8_t *bench_buffer_new(const BufferIsZeroOpts *opts)
+{
+    uint8_t *buf = qemu_memalign(4096, buf_size);
+    size_t i;
+
+    memset(buf, 0, buf_size);
+    for (i = 0; i < buf_size; i += opts->chunk_size) {
+        if (g_test_rand_int_range(0, 100) >= opts->zero_percent) {
+            buf[i + g_test_rand_int_range(0, opts->chunk_size)] = 1;
+        }
+    }
+    return buf;
+}
+
+static void test_bufferiszero_speed(const void *opaque)
+{
+    const BufferIsZeroOpts *opts = opaque;
+    uint8_t *buf = bench_buffer_new(opts);
+    size_t remain;
+    size_t i;
+
+    do {
+        g_test_timer_start();
+        for (remain = total; remain; remain -= buf_size) {
+            for (i = 0; i < buf_size; i += opts->chunk_size) {
+                buffer_is_zero(buf + i, opts->chunk_size);
+            }
+        }
+        g_test_timer_elapsed();
+
+        g_test_message("buffer_is_zero (%s): chunk %zu bytes, %u%% zero, "
+                       "%.2f MB/sec", test_buffer_is_zero_accel_name(),
+                       opts->chunk_size, opts->zero_percent,
+                       total / MiB / g_test_timer_last());
+    } while (test_buffer_is_zero_next_accel());
+
+    qemu_vfree(buf);
+}
+
+static void test_zero_pages_speed(const void *opaque)
+{
+    const BufferIsZeroOpts *opts = opaque;
+    uint8_t *buf = bench_buffer_new(opts);
+    unsigned long *bitmap = bitmap_new(buf_size / opts->chunk_size);
+    size_t remain;
+
+    g_test_timer_start();
+    for (remain = total; remain; remain -= buf_size) {
+        buffer_zero_pages(buf, buf_size, opts->chunk_size, bitmap);
+    }
+    g_test_timer_elapsed();
+
+    g_test_message("buffer_zero_pages (%s): page %zu bytes, %u%% zero, "
+                   "%.2f MB/sec", test_buffer_is_zero_accel_name(),
+                   opts->chunk_size, opts->zero_percent,
+                   total / MiB / g_test_timer_last());
+
+    g_free(bitmap);
+    qemu_vfree(buf);
+}
+
+int main(int argc, char **argv)
+{
+    static const size_t chunk_sizes[] = { 64, 512, 4096, 64 * KiB };
+    static const unsigned zero_percents[] = { 0, 50, 90, 100 };
+    BufferIsZeroOpts *opts;
+    int i, j;
+
+    g_test_init(&argc, &argv, NULL);
+
+    for (i = 0; i < ARRAY_SIZE(chunk_sizes); i++) {
+        for (j = 0; j < ARRAY_SIZE(zero_percents); j++) {
+            g_autofree char *name = NULL;
+
+            /* Shared by both tests, so it is never freed.  */
+            opts = g_new(BufferIsZeroOpts, 1);
+            opts->chunk_size = chunk_sizes[i];
+            opts->zero_percent = zero_percents[j];
+
+            name = g_strdup_printf("/bufferiszero/benchmark/bufsize-%zu/"
+                                   "zero-%u", opts->chunk_size,
+                                   opts->zero_percent);
+            g_test_add_data_func(name, opts, test_bufferiszero_speed);
+
+            g_free(name);
+            name = g_strdup_printf("/bufferiszero/benchmark/pages/"
+                                   "bufsize-%zu/zero-%u", opts->chunk_size,
+                                   opts->zero_percent);
+            g_test_add_data_func(name, opts, test_zero_pages_speed);
+        }
+    }
+
+    return g_test_run();
+}
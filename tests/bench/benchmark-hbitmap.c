@@ -0,0 +1,126 @@
+/*
+ * QEMU hierarchical bitmap speed benchmark
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or
+ * (at your option) any later version.  See the COPYING file in the
+ * top-level directory.
+ */
+#include "qemu/osdep.h"
+#include "qemu/units.h"
+#include "qemu/hbitmap.h"
+
+/* A 4 TiB disk tracked at 64 KiB granularity */
+#define BENCH_DISK_SIZE     (4 * TiB)
+#define BENCH_GRANULARITY   16
+
+typedef struct HBitmapBenchOpts {
+    const char *name;
+    uint64_t run_len;   /* length of each dirty run, in bytes */
+    uint64_t stride;    /* distance between the starts of two runs */
+} HBitmapBenchOpts;
+
+static HBitmap *bench_bitmap_new(const HBitmapBenchOpts *opts)
+{
+    HBitmap *hb = hbitmap_alloc(BENCH_DISK_SIZE, BENCH_GRANULARITY);
+    uint64_t offset;
+
+    for (offset = 0; offset < BENCH_DISK_SIZE; offset += opts->stride) {
+        hbitmap_set(hb, offset, MIN(opts->run_len, BENCH_DISK_SIZE - offset));
+    }
+    return hb;
+}
+
+static void test_dirty_area_speed(const void *opaque)
+{
+    const HBitmapBenchOpts *opts = opaque;
+    HBitmap *hb = bench_bitmap_new(opts);
+    int64_t offset = 0, dirty_start, dirty_count;
+    uint64_t areas = 0;
+
+    g_test_timer_start();
+    while (hbitmap_next_dirty_area(hb, offset, INT64_MAX, INT64_MAX,
+                                   &dirty_start, &dirty_count)) {
+        offset = dirty_start + dirty_count;
+        areas++;
+    }
+    g_test_timer_elapsed();
+
+    g_test_message("next_dirty_area(%s): %" PRIu64 " areas in %.3f ms",
+                   opts->name, areas, g_test_timer_last() * 1000);
+
+    hbitmap_free(hb);
+}
+
+static void test_iter_speed(const void *opaque)
+{
+    const HBitmapBenchOpts *opts = opaque;
+    HBitmap *hb = bench_bitmap_new(opts);
+    HBitmapIter hbi;
+    uint64_t items = 0;
+
+    g_test_timer_start();
+    hbitmap_iter_init(&hbi, hb, 0);
+    while (hbitmap_iter_next(&hbi) >= 0) {
+        items++;
+    }
+    g_test_timer_elapsed();
+
+    g_test_message("iter_next(%s): %" PRIu64 " items in %.3f ms",
+                   opts->name, items, g_test_timer_last() * 1000);
+
+    hbitmap_free(hb);
+}
+
+static void test_serialize_speed(const void *opaque)
+{
+    const HBitmapBenchOpts *opts = opaque;
+    HBitmap *hb = bench_bitmap_new(opts);
+    uint64_t chunk = hbitmap_serialization_align(hb) * 4096;
+    uint64_t size = hbitmap_serialization_size(hb, 0, chunk);
+    uint8_t *buf = g_malloc(size);
+    uint64_t offset;
+
+    g_test_timer_start();
+    for (offset = 0; offset < BENCH_DISK_SIZE; offset += chunk) {
+        hbitmap_serialize_part(hb, buf, offset, chunk);
+    }
+    for (offset = 0; offset < BENCH_DISK_SIZE; offset += chunk) {
+        hbitmap_deserialize_part(hb, buf, offset, chunk, false);
+    }
+    hbitmap_deserialize_finish(hb);
+    g_test_timer_elapsed();
+
+    g_test_message("serialize+deserialize(%s): %.3f ms",
+                   opts->name, g_test_timer_last() * 1000);
+
+    g_free(buf);
+    hbitmap_free(hb);
+}
+
+int main(int argc, char **argv)
+{
+    static const HBitmapBenchOpts opts[] = {
+        { "sparse", 64 * KiB, 64 * MiB },
+        { "fragmented", 64 * KiB, 128 * KiB },
+        { "runs", 256 * MiB, 512 * MiB },
+        { "full", BENCH_DISK_SIZE, BENCH_DISK_SIZE },
+    };
+    int i;
+
+    g_test_init(&argc, &argv, NULL);
+
+    for (i = 0; i < ARRAY_SIZE(opts); i++) {
+        g_autofree char *area = g_strdup_printf(
+            "/hbitmap/benchmark/next_dirty_area/%s", opts[i].name);
+        g_autofree char *iter = g_strdup_printf(
+            "/hbitmap/benchmark/iter/%s", opts[i].name);
+        g_autofree char *ser = g_strdup_printf(
+            "/hbitmap/benchmark/serialize/%s", opts[i].name);
+
+        g_test_add_data_func(area, &opts[i], test_dirty_area_speed);
+        g_test_add_data_func(iter, &opts[i], test_iter_speed);
+        g_test_add_data_func(ser, &opts[i], test_serialize_speed);
+    }
+
+    return g_test_run();
+}
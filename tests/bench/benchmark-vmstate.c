@@ -0,0 +1,102 @@
+/*
+ * QEMU VMState array save/load speed benchmark
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or
+ * (at your option) any later version.  See the COPYING file in the
+ * top-level directory.
+ */
+#include "qemu/osdep.h"
+#include "qemu/units.h"
+#include "qemu/module.h"
+#include "migration/vmstate.h"
+#include "../migration/qemu-file.h"
+#include "../migration/qemu-file-channel.h"
+#include "../migration/savevm.h"
+#include "io/channel-buffer.h"
+
+#define BENCH_ARRAY_LEN (64 * KiB)
+
+typedef struct BenchState {
+    uint8_t u8[BENCH_ARRAY_LEN];
+    uint16_t u16[BENCH_ARRAY_LEN];
+    uint32_t u32[BENCH_ARRAY_LEN];
+    uint64_t u64[BENCH_ARRAY_LEN];
+} BenchState;
+
+static const VMStateDescription vmstate_bench = {
+    .name = "bench",
+    .version_id = 1,
+    .minimum_version_id = 1,
+    .fields = (VMStateField[]) {
+        VMSTATE_UINT8_ARRAY(u8, BenchState, BENCH_ARRAY_LEN),
+        VMSTATE_UINT16_ARRAY(u16, BenchState, BENCH_ARRAY_LEN),
+        VMSTATE_UINT32_ARRAY(u32, BenchState, BENCH_ARRAY_LEN),
+        VMSTATE_UINT64_ARRAY(u64, BenchState, BENCH_ARRAY_LEN),
+        VMSTATE_END_OF_LIST()
+    }
+};
+
+static const size_t total = 4 * GiB;
+
+/*
+ * Save to and load from memory, reusing the same QEMUFiles, so that
+ * only the vmstate code is measured.  Each pass ends with QEMU_VM_EOF
+ * like a real stream, because loading peeks one byte past the last
+ * field for subsections.
+ */
+static void test_vmstate_speed(void)
+{
+    BenchState *s = g_new(BenchState, 1);
+    QIOChannelBuffer *bioc = qio_channel_buffer_new(2 * sizeof(*s));
+    QEMUFile *fsave, *fload;
+    size_t remain, i;
+
+    for (i = 0; i < BENCH_ARRAY_LEN; i++) {
+        s->u8[i] = g_test_rand_int();
+        s->u16[i] = g_test_rand_int();
+        s->u32[i] = g_test_rand_int();
+        s->u64[i] = (uint64_t)g_test_rand_int() << 32 | g_test_rand_int();
+    }
+
+    fsave = qemu_fopen_channel_output(QIO_CHANNEL(bioc));
+    fload = qemu_fopen_channel_input(QIO_CHANNEL(bioc));
+
+    g_test_timer_start();
+    for (remain = total; remain >= sizeof(*s); remain -= sizeof(*s)) {
+        bioc->usage = 0;
+        bioc->offset = 0;
+        g_assert(!vmstate_save_state(fsave, &vmstate_bench, s, NULL));
+        qemu_put_byte(fsave, QEMU_VM_EOF);
+        qemu_fflush(fsave);
+        g_assert(!qemu_file_get_error(fsave));
+    }
+    g_test_timer_elapsed();
+    g_test_message("vmstate_save_state: %.2f GB/sec",
+                   total / GiB / g_test_timer_last());
+
+    g_test_timer_start();
+    for (remain = total; remain >= sizeof(*s); remain -= sizeof(*s)) {
+        /* Rewinds the buffer and drops what fload has read ahead */
+        qemu_set_offset(fload, 0);
+        g_assert(!vmstate_load_state(fload, &vmstate_bench, s, 1));
+        g_assert_cmpint(qemu_get_byte(fload), ==, QEMU_VM_EOF);
+        g_assert(!qemu_file_get_error(fload));
+    }
+    g_test_timer_elapsed();
+    g_test_message("vmstate_load_state: %.2f GB/sec",
+                   total / GiB / g_test_timer_last());
+
+    qemu_fclose(fload);
+    qemu_fclose(fsave);
+    object_unref(OBJECT(bioc));
+    g_free(s);
+}
+
+int main(int argc, char **argv)
+{
+    module_call_init(MODULE_INIT_QOM);
+
+    g_test_init(&argc, &argv, NULL);
+    g_test_add_func("/vmstate/benchmark/array", test_vmstate_speed);
+    return g_test_run();
+}
@@ -0,0 +1,108 @@
+/*
+ * QEMU XBZRLE encoder speed benchmark
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or
+ * (at your option) any later version.  See the COPYING file in the
+ * top-level directory.
+ */
+#include "qemu/osdep.h"
+#include "qemu/units.h"
+#include "qemu/cutils.h"
+#include "../migration/xbzrle.h"
+
+#define XBZRLE_PAGE_SIZE 4096
+
+typedef struct XbzrleOpts {
+    /* length of each dirtied run, in bytes */
+    unsigned run_len;
+    /* percentage of the page that is dirtied */
+    unsigned dirty_percent;
+} XbzrleOpts;
+
+static const size_t total = 2 * GiB;
+static const size_t buf_size = 16 * MiB;
+
+/*
+ * Build a copy of @old where about @dirty_percent of every page has been
+ * changed, in runs of @run_len bytes at random offsets.
+ */
+static uint8_t *bench_buffer_dirty(const XbzrleOpts *opts, const uint8_t *old)
+{
+    uint8_t *new = g_memdup2(old, buf_size);
+    size_t runs = XBZRLE_PAGE_SIZE * opts->dirty_percent / 100 / opts->run_len;
+    size_t i, j, k;
+
+    for (i = 0; i < buf_size; i += XBZRLE_PAGE_SIZE) {
+        for (j = 0; j < runs; j++) {
+            size_t start = g_test_rand_int_range(0, XBZRLE_PAGE_SIZE -
+                                                    opts->run_len + 1);
+
+            for (k = 0; k < opts->run_len; k++) {
+                new[i + start + k] = ~old[i + start + k];
+            }
+        }
+    }
+    return new;
+}
+
+static void test_xbzrle_encode_speed(const void *opaque)
+{
+    const XbzrleOpts *opts = opaque;
+    uint8_t *old = g_malloc(buf_size);
+    uint8_t *new;
+    uint8_t *dst = g_malloc(XBZRLE_PAGE_SIZE);
+    size_t remain;
+    size_t i;
+
+    for (i = 0; i < buf_size; i++) {
+        old[i] = g_test_rand_int();
+    }
+    new = bench_buffer_dirty(opts, old);
+
+    do {
+        g_test_timer_start();
+        for (remain = total; remain; remain -= buf_size) {
+            for (i = 0; i < buf_size; i += XBZRLE_PAGE_SIZE) {
+                xbzrle_encode_buffer(old + i, new + i, XBZRLE_PAGE_SIZE,
+                                     dst, XBZRLE_PAGE_SIZE);
+            }
+        }
+        g_test_timer_elapsed();
+
+        g_test_message("xbzrle_encode_buffer: run %u bytes, %u%% dirty, "
+                       "%.2f GB/sec", opts->run_len, opts->dirty_percent,
+                       total / GiB / g_test_timer_last());
+    } while (test_xbzrle_encode_next_accel());
+
+    g_free(old);
+    g_free(new);
+    g_free(dst);
+}
+
+int main(int argc, char **argv)
+{
+    static const unsigned run_lens[] = { 1, 8, 64 };
+    static const unsigned dirty_percents[] = { 0, 1, 10, 30 };
+    XbzrleOpts *opts;
+    int i, j;
+
+    g_test_init(&argc, &argv, NULL);
+
+    for (i = 0; i < ARRAY_SIZE(run_lens); i++) {
+        for (j = 0; j < ARRAY_SIZE(dirty_percents); j++) {
+            g_autofree char *name = NULL;
+
+            /* Referenced by the test case, so it is never freed.  */
+            opts = g_new(XbzrleOpts, 1);
+            opts->run_len = run_lens[i];
+            opts->dirty_percent = dirty_percents[j];
+
+            name = g_strdup_printf("/xbzrle/benchmark/encode/run-%u/"
+                                   "dirty-%u", opts->run_len,
+                                   opts->dirty_percent);
+            g_test_add_data_func(name, opts, test_xbzrle_encode_speed);
+        }
+    }
+
+    return g_test_run();
+}
@@ -43,6 +43,7 @@ static bool uffd_feature_thread_id;
 #define CONVERGE_DOWNTIME 1000
 
 #if defined(__linux__)
+#include <sys/resource.h>
 #include <sys/syscall.h>
 #include <sys/vfs.h>
 #endif
@@ -654,6 +655,7 @@ static void test_migrate_end(QTestState *from, QTestState *to, bool test_dest)
 
     cleanup("bootsect");
     cleanup("migsocket");
+    cleanup("migfile");
     cleanup("src_serial");
     cleanup("dest_serial");
 }
@@ -887,6 +889,53 @@ static void test_ignore_shared(void)
 }
 #endif
 
+/*
+ * The guests are much smaller than the default 1 GiB chunk, so use
+ * small chunks to have the dirty bitmap synced by several threads.
+ */
+static void test_precopy_bitmap_sync_threads(void)
+{
+    g_autofree char *uri = g_strdup_printf("unix:%s/migsocket", tmpfs);
+    MigrateStart *args = migrate_start_new();
+    QTestState *from, *to;
+
+    g_free(args->opts_source);
+    args->opts_source =
+        g_strdup("-global migration.x-bitmap-sync-threads=4 "
+                 "-global migration.x-bitmap-sync-chunk-size=4M "
+                 "-global migration.x-clear-bitmap-shift=6");
+
+    if (test_migrate_start(&from, &to, uri, args)) {
+        return;
+    }
+
+    /* 1 ms should make it not converge*/
+    migrate_set_parameter_int(from, "downtime-limit", 1);
+    /* 1GB/s */
+    migrate_set_parameter_int(from, "max-bandwidth", 1000000000);
+
+    /* Wait for the first serial output from the source */
+    wait_for_serial("src_serial");
+
+    migrate_qmp(from, uri, "{}");
+
+    wait_for_migration_pass(from);
+    /* Make sure the pages dirtied during the first pass are synced too */
+    wait_for_migration_pass(from);
+
+    migrate_set_parameter_int(from, "downtime-limit", CONVERGE_DOWNTIME);
+
+    if (!got_stop) {
+        qtest_qmp_eventwait(from, "STOP");
+    }
+    qtest_qmp_eventwait(to, "RESUME");
+
+    wait_for_serial("dest_serial");
+    wait_for_migration_complete(from);
+
+    test_migrate_end(from, to, true);
+}
+
 static void test_xbzrle(const char *uri)
 {
     MigrateStart *args = migrate_start_new();
@@ -940,6 +989,49 @@ static void test_xbzrle_unix(void)
     test_xbzrle(uri);
 }
 
+static void test_page_dedup_unix(void)
+{
+    g_autofree char *uri = g_strdup_printf("unix:%s/migsocket", tmpfs);
+    MigrateStart *args = migrate_start_new();
+    QTestState *from, *to;
+
+    if (test_migrate_start(&from, &to, uri, args)) {
+        return;
+    }
+
+    /* 1 ms should make it not converge*/
+    migrate_set_parameter_int(from, "downtime-limit", 1);
+    /* 1GB/s */
+    migrate_set_parameter_int(from, "max-bandwidth", 1000000000);
+
+    /* Only the source needs it */
+    migrate_set_capability(from, "page-dedup", true);
+    /* Wait for the first serial output from the source */
+    wait_for_serial("src_serial");
+
+    migrate_qmp(from, uri, "{}");
+
+    wait_for_migration_pass(from);
+    /* Make sure we have 2 passes, so that resent pages are dropped */
+    wait_for_migration_pass(from);
+
+    /* 1000ms should converge */
+    migrate_set_parameter_int(from, "downtime-limit", 1000);
+
+    if (!got_stop) {
+        qtest_qmp_eventwait(from, "STOP");
+    }
+    qtest_qmp_eventwait(to, "RESUME");
+
+    wait_for_serial("dest_serial");
+    wait_for_migration_complete(from);
+
+    /* The test loop leaves most pages with the same content */
+    g_assert_cmpint(read_ram_property_int(from, "dedup-pages"), >, 0);
+
+    test_migrate_end(from, to, true);
+}
+
 static void test_precopy_tcp(void)
 {
     MigrateStart *args = migrate_start_new();
@@ -982,6 +1074,79 @@ static void test_precopy_tcp(void)
     test_migrate_end(from, to, true);
 }
 
+#if defined(CONFIG_LINUX) && defined(SO_ZEROCOPY)
+static bool zero_copy_send_supported(void)
+{
+    struct rlimit rlim;
+    bool ret;
+    int fd, v = 1;
+
+    /*
+     * Pages being sent zero copy count against RLIMIT_MEMLOCK, QEMU keeps
+     * up to two writes of 256 pages in flight
+     */
+    if (getrlimit(RLIMIT_MEMLOCK, &rlim) < 0 ||
+        (rlim.rlim_cur != RLIM_INFINITY && rlim.rlim_cur < 8 * 1024 * 1024)) {
+        return false;
+    }
+
+    fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (fd < 0) {
+        return false;
+    }
+    ret = setsockopt(fd, SOL_SOCKET, SO_ZEROCOPY, &v, sizeof(v)) == 0;
+    close(fd);
+    return ret;
+}
+
+static void test_precopy_tcp_zero_copy(void)
+{
+    MigrateStart *args = migrate_start_new();
+    g_autofree char *uri = NULL;
+    QTestState *from, *to;
+
+    if (!zero_copy_send_supported()) {
+        g_test_skip("SO_ZEROCOPY is not supported");
+        migrate_start_destroy(args);
+        return;
+    }
+
+    if (test_migrate_start(&from, &to, "tcp:127.0.0.1:0", args)) {
+        return;
+    }
+
+    /* 1 ms should make it not converge*/
+    migrate_set_parameter_int(from, "downtime-limit", 1);
+    /* 1GB/s */
+    migrate_set_parameter_int(from, "max-bandwidth", 1000000000);
+
+    /* Only the source needs it */
+    migrate_set_capability(from, "zero-copy-send", true);
+    /* Wait for the first serial output from the source */
+    wait_for_serial("src_serial");
+
+    uri = migrate_get_socket_address(to, "socket-address");
+
+    migrate_qmp(from, uri, "{}");
+
+    wait_for_migration_pass(from);
+    /* Make sure we have 2 passes, so that pages are sent again */
+    wait_for_migration_pass(from);
+
+    migrate_set_parameter_int(from, "downtime-limit", CONVERGE_DOWNTIME);
+
+    if (!got_stop) {
+        qtest_qmp_eventwait(from, "STOP");
+    }
+    qtest_qmp_eventwait(to, "RESUME");
+
+    wait_for_serial("dest_serial");
+    wait_for_migration_complete(from);
+
+    test_migrate_end(from, to, true);
+}
+#endif
+
 static void test_migrate_fd_proto(void)
 {
     MigrateStart *args = migrate_start_new();
@@ -1066,6 +1231,60 @@ static void test_migrate_fd_proto(void)
     test_migrate_end(from, to, true);
 }
 
+static void test_mapped_ram_fd(void)
+{
+    g_autofree char *file = g_strdup_printf("%s/migfile", tmpfs);
+    MigrateStart *args = migrate_start_new();
+    QTestState *from, *to;
+    QDict *rsp;
+    int fd;
+
+    if (test_migrate_start(&from, &to, "defer", args)) {
+        return;
+    }
+
+    migrate_set_capability(from, "mapped-ram", true);
+    migrate_set_capability(to, "mapped-ram", true);
+
+    /* Wait for the first serial output from the source */
+    wait_for_serial("src_serial");
+
+    /* Save to a regular file, pages land at fixed offsets in it */
+    fd = open(file, O_CREAT | O_RDWR | O_TRUNC, 0660);
+    g_assert_cmpint(fd, >=, 0);
+    rsp = wait_command_fd(from, fd,
+                          "{ 'execute': 'getfd',"
+                          "  'arguments': { 'fdname': 'fd-mig' }}");
+    qobject_unref(rsp);
+    close(fd);
+
+    migrate_set_parameter_int(from, "downtime-limit", CONVERGE_DOWNTIME);
+    migrate_qmp(from, "fd:fd-mig", "{}");
+
+    if (!got_stop) {
+        qtest_qmp_eventwait(from, "STOP");
+    }
+    wait_for_migration_complete(from);
+
+    /* Load it back from the start of the file */
+    fd = open(file, O_RDONLY);
+    g_assert_cmpint(fd, >=, 0);
+    rsp = wait_command_fd(to, fd,
+                          "{ 'execute': 'getfd',"
+                          "  'arguments': { 'fdname': 'fd-mig' }}");
+    qobject_unref(rsp);
+    close(fd);
+
+    rsp = wait_command(to, "{ 'execute': 'migrate-incoming',"
+                           "  'arguments': { 'uri': 'fd:fd-mig' }}");
+    qobject_unref(rsp);
+
+    qtest_qmp_eventwait(to, "RESUME");
+    wait_for_serial("dest_serial");
+
+    test_migrate_end(from, to, true);
+}
+
 static void do_test_validate_uuid(MigrateStart *args, bool should_fail)
 {
     g_autofree char *uri = g_strdup_printf("unix:%s/migsocket", tmpfs);
@@ -1462,9 +1681,17 @@ int main(int argc, char **argv)
     qtest_add_func("/migration/bad_dest", test_baddest);
     qtest_add_func("/migration/precopy/unix", test_precopy_unix);
     qtest_add_func("/migration/precopy/tcp", test_precopy_tcp);
+#if defined(CONFIG_LINUX) && defined(SO_ZEROCOPY)
+    qtest_add_func("/migration/precopy/tcp/zero-copy",
+                   test_precopy_tcp_zero_copy);
+#endif
     /* qtest_add_func("/migration/ignore_shared", test_ignore_shared); */
     qtest_add_func("/migration/xbzrle/unix", test_xbzrle_unix);
+    qtest_add_func("/migration/precopy/unix/bitmap-sync-threads",
+                   test_precopy_bitmap_sync_threads);
+    qtest_add_func("/migration/page_dedup/unix", test_page_dedup_unix);
     qtest_add_func("/migration/fd_proto", test_migrate_fd_proto);
+    qtest_add_func("/migration/mapped_ram/fd", test_mapped_ram_fd);
     qtest_add_func("/migration/validate_uuid", test_validate_uuid);
     qtest_add_func("/migration/validate_uuid_error", test_validate_uuid_error);
     qtest_add_func("/migration/validate_uuid_src_not_set",
@@ -915,6 +915,48 @@ static void test_worker_thread_co_enter(void)
 
 /* End of tests.  */
 
+#ifndef _WIN32
+static void test_poll_adaptive(void)
+{
+    TimerTestData data = { .n = 0, .ctx = ctx, .ns = SCALE_MS,
+                           .max = INT_MAX,
+                           .clock_type = QEMU_CLOCK_REALTIME };
+    Error *err = NULL;
+    EventNotifier e;
+
+    /* aio_poll only blocks for timers if it has an fd to wait on */
+    event_notifier_init(&e, false);
+    set_event_notifier(ctx, &e, dummy_io_handler_read);
+    do {} while (aio_poll(ctx, false));
+
+    aio_context_set_poll_params(ctx, 50 * SCALE_MS, 0, 0, 90, &error_abort);
+    g_assert_cmpint(ctx->poll_ns, ==, 0);
+
+    /* Out of range targets are rejected and leave the settings alone */
+    aio_context_set_poll_params(ctx, 50 * SCALE_MS, 0, 0, 150, &err);
+    error_free_or_abort(&err);
+    g_assert_cmpint(ctx->poll_hit_target, ==, 90);
+
+    /*
+     * Every wait lasts about 1 ms, so after a full window the polling time
+     * covers that, but stays within poll-max-ns.
+     */
+    aio_timer_init(ctx, &data.timer, data.clock_type,
+                   SCALE_NS, timer_test_cb, &data);
+    timer_mod(&data.timer, qemu_clock_get_ns(data.clock_type) + data.ns);
+    while (data.n < 256) {
+        aio_poll(ctx, true);
+    }
+    g_assert_cmpint(ctx->poll_ns, >=, SCALE_MS);
+    g_assert_cmpint(ctx->poll_ns, <=, 50 * SCALE_MS);
+
+    timer_del(&data.timer);
+    aio_context_set_poll_params(ctx, 0, 0, 0, 0, &error_abort);
+    set_event_notifier(ctx, &e, NULL);
+    event_notifier_cleanup(&e);
+}
+#endif
+
 int main(int argc, char **argv)
 {
     qemu_init_main_loop(&error_fatal);
@@ -937,6 +979,9 @@ int main(int argc, char **argv)
     g_test_add_func("/aio/event/flush",             test_flush_event_notifier);
     g_test_add_func("/aio/external-client",         test_aio_external_client);
     g_test_add_func("/aio/timer/schedule",          test_timer_schedule);
+#ifndef _WIN32
+    g_test_add_func("/aio/poll/adaptive",           test_poll_adaptive);
+#endif
 
     g_test_add_func("/aio/coroutine/queue-chaining", test_queue_chaining);
     g_test_add_func("/aio/coroutine/worker-thread-co-enter", test_worker_thread_co_enter);
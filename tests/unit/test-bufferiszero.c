@@ -20,6 +20,7 @@
 
 #include "qemu/osdep.h"
 #include "qemu/cutils.h"
+#include "qemu/bitmap.h"
 
 static char buffer[8 * 1024 * 1024];
 
@@ -69,10 +70,47 @@ static void test_2(void)
     }
 }
 
+static void test_pages(void)
+{
+    const size_t page_size = 4096;
+    const size_t nr_pages = sizeof(buffer) / page_size;
+    unsigned long *bitmap = bitmap_new(nr_pages);
+    size_t zero_pages;
+    size_t i;
+
+    /* Mark every third page non-zero, in a varying position.  */
+    for (i = 0; i < nr_pages; i += 3) {
+        buffer[i * page_size + i % page_size] = 1;
+    }
+
+    zero_pages = buffer_zero_pages(buffer, sizeof(buffer), page_size, bitmap);
+    g_assert_cmpuint(zero_pages, ==, nr_pages - DIV_ROUND_UP(nr_pages, 3));
+    for (i = 0; i < nr_pages; i++) {
+        g_assert(test_bit(i, bitmap) == (i % 3 != 0));
+    }
+
+    for (i = 0; i < nr_pages; i += 3) {
+        buffer[i * page_size + i % page_size] = 0;
+    }
+
+    /* A partial last page is only checked up to the end of the buffer.  */
+    buffer[page_size + 16] = 1;
+    zero_pages = buffer_zero_pages(buffer, page_size + 16, page_size, bitmap);
+    g_assert_cmpuint(zero_pages, ==, 2);
+    zero_pages = buffer_zero_pages(buffer, page_size + 17, page_size, bitmap);
+    g_assert_cmpuint(zero_pages, ==, 1);
+    g_assert(test_bit(0, bitmap));
+    g_assert(!test_bit(1, bitmap));
+    buffer[page_size + 16] = 0;
+
+    g_free(bitmap);
+}
+
 int main(int argc, char **argv)
 {
     g_test_init(&argc, &argv, NULL);
     g_test_add_func("/cutils/bufferiszero", test_2);
+    g_test_add_func("/cutils/bufferiszero/pages", test_pages);
 
     return g_test_run();
 }
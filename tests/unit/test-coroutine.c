@@ -451,6 +451,52 @@ static void test_lifecycle(void)
     g_assert(done); /* expect done to be true (second time) */
 }
 
+/*
+ * Check that shrinking the pool frees the surplus coroutines and that the
+ * remaining pooled coroutines can still be reused.
+ */
+static void test_pool_trim(void)
+{
+    const unsigned int n = 256;
+    Coroutine **coroutines;
+    bool done = false;
+    unsigned int i, size;
+
+    if (!CONFIG_COROUTINE_POOL) {
+        g_test_skip("coroutine pool disabled");
+        return;
+    }
+
+    coroutines = g_new(Coroutine *, n);
+    qemu_coroutine_increase_pool_batch_size(n);
+
+    /* Keep all coroutines alive at once so that they all end up pooled */
+    for (i = 0; i < n; i++) {
+        coroutines[i] = qemu_coroutine_create(yield_5_times, &done);
+        qemu_coroutine_enter(coroutines[i]);
+    }
+    while (!done) {
+        for (i = 0; i < n; i++) {
+            qemu_coroutine_enter(coroutines[i]);
+        }
+    }
+
+    /* They all went back to the shared pool, which had room for them */
+    size = qemu_coroutine_get_pool_size();
+    g_assert_cmpuint(size, >=, n);
+
+    /* Back to twice the initial batch size of 64 */
+    qemu_coroutine_decrease_pool_batch_size(n);
+    g_assert_cmpuint(qemu_coroutine_get_pool_size(), <=, 128);
+    g_assert_cmpuint(qemu_coroutine_get_pool_size(), <, size);
+
+    done = false;
+    coroutines[0] = qemu_coroutine_create(set_and_exit, &done);
+    qemu_coroutine_enter(coroutines[0]);
+    g_assert(done);
+
+    g_free(coroutines);
+}
 
 #define RECORD_SIZE 10 /* Leave some room for expansion */
 struct coroutine_position {
@@ -652,6 +698,7 @@ int main(int argc, char **argv)
     }
 
     g_test_add_func("/basic/lifecycle", test_lifecycle);
+    g_test_add_func("/basic/pool-trim", test_pool_trim);
     g_test_add_func("/basic/yield", test_yield);
     g_test_add_func("/basic/nesting", test_nesting);
     g_test_add_func("/basic/self", test_self);
@@ -0,0 +1,166 @@
+/*
+ * QEMUFile positioned I/O unit tests
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or later.
+ * See the COPYING file in the top-level directory.
+ */
+
+#include "qemu/osdep.h"
+
+#include "../migration/qemu-file.h"
+#include "../migration/qemu-file-channel.h"
+#include "migration/qemu-file-types.h"
+#include "qemu/module.h"
+#include "io/channel-file.h"
+
+static int temp_fd;
+
+/* Duplicate temp_fd and seek to the beginning of the file */
+static QEMUFile *open_test_file(bool write)
+{
+    int fd;
+    QIOChannel *ioc;
+    QEMUFile *f;
+
+    fd = dup(temp_fd);
+    g_assert(fd >= 0);
+    lseek(fd, 0, SEEK_SET);
+    if (write) {
+        g_assert_cmpint(ftruncate(fd, 0), ==, 0);
+    }
+    ioc = QIO_CHANNEL(qio_channel_file_new_fd(fd));
+    if (write) {
+        f = qemu_fopen_channel_output(ioc);
+    } else {
+        f = qemu_fopen_channel_input(ioc);
+    }
+    object_unref(OBJECT(ioc));
+    return f;
+}
+
+#define HEAD_SIZE   100
+#define AT_OFFSET   1024
+#define AT_SIZE     512
+#define TAIL_OFFSET 4096
+
+static void test_offset_save(void)
+{
+    QEMUFile *f = open_test_file(true);
+    uint8_t head[HEAD_SIZE], at[AT_SIZE];
+
+    if (!qemu_file_is_seekable(f)) {
+        g_test_skip("positioned I/O not supported on this host");
+        qemu_fclose(f);
+        return;
+    }
+
+    memset(head, 0x11, sizeof(head));
+    memset(at, 0x22, sizeof(at));
+
+    qemu_put_buffer(f, head, sizeof(head));
+    /* Pending data is flushed first */
+    g_assert_cmpint(qemu_get_offset(f), ==, HEAD_SIZE);
+
+    /* Positioned writes leave the stream where it was */
+    qemu_put_buffer_at(f, at, sizeof(at), AT_OFFSET);
+    g_assert_cmpint(qemu_get_offset(f), ==, HEAD_SIZE);
+
+    qemu_set_offset(f, TAIL_OFFSET);
+    qemu_put_be64(f, 0x0123456789abcdefULL);
+    g_assert_cmpint(qemu_get_offset(f), ==, TAIL_OFFSET + 8);
+
+    g_assert(!qemu_file_get_error(f));
+    g_assert_cmpint(qemu_fclose(f), ==, 0);
+}
+
+static void test_offset_load(void)
+{
+    QEMUFile *f = open_test_file(false);
+    uint8_t head[HEAD_SIZE], at[AT_SIZE], gap[AT_OFFSET - HEAD_SIZE];
+    int i;
+
+    if (!qemu_file_is_seekable(f)) {
+        g_test_skip("positioned I/O not supported on this host");
+        qemu_fclose(f);
+        return;
+    }
+
+    g_assert_cmpint(qemu_get_buffer(f, head, sizeof(head)), ==, HEAD_SIZE);
+    for (i = 0; i < HEAD_SIZE; i++) {
+        g_assert_cmpint(head[i], ==, 0x11);
+    }
+    /* The stream has read ahead past the head, but it is not consumed */
+    g_assert_cmpint(qemu_get_offset(f), ==, HEAD_SIZE);
+
+    g_assert_cmpint(qemu_get_buffer_at(f, at, sizeof(at), AT_OFFSET),
+                    ==, AT_SIZE);
+    for (i = 0; i < AT_SIZE; i++) {
+        g_assert_cmpint(at[i], ==, 0x22);
+    }
+    g_assert_cmpint(qemu_get_buffer_at(f, gap, sizeof(gap), HEAD_SIZE),
+                    ==, sizeof(gap));
+    for (i = 0; i < sizeof(gap); i++) {
+        g_assert_cmpint(gap[i], ==, 0);
+    }
+    g_assert_cmpint(qemu_get_offset(f), ==, HEAD_SIZE);
+
+    qemu_set_offset(f, TAIL_OFFSET);
+    g_assert_cmphex(qemu_get_be64(f), ==, 0x0123456789abcdefULL);
+
+    /* Reading past the end of the file is an error */
+    g_assert_cmpint(qemu_get_buffer_at(f, at, sizeof(at), TAIL_OFFSET),
+                    ==, 0);
+    g_assert(qemu_file_get_error(f));
+    qemu_fclose(f);
+}
+
+#ifndef _WIN32
+static void test_not_seekable(void)
+{
+    uint8_t buf[16] = { 0 };
+    QIOChannel *ioc;
+    QEMUFile *f;
+    int fds[2];
+
+    g_assert_cmpint(pipe(fds), ==, 0);
+
+    ioc = QIO_CHANNEL(qio_channel_file_new_fd(fds[1]));
+    f = qemu_fopen_channel_output(ioc);
+    object_unref(OBJECT(ioc));
+    g_assert(!qemu_file_is_seekable(f));
+    qemu_put_buffer_at(f, buf, sizeof(buf), 0);
+    g_assert(qemu_file_get_error(f));
+    qemu_fclose(f);
+
+    ioc = QIO_CHANNEL(qio_channel_file_new_fd(fds[0]));
+    f = qemu_fopen_channel_input(ioc);
+    object_unref(OBJECT(ioc));
+    g_assert(!qemu_file_is_seekable(f));
+    g_assert_cmpint(qemu_get_buffer_at(f, buf, sizeof(buf), 0), ==, 0);
+    g_assert(qemu_file_get_error(f));
+    qemu_fclose(f);
+}
+#endif
+
+int main(int argc, char **argv)
+{
+    g_autofree char *temp_file = g_strdup_printf("%s/qemufile.test.XXXXXX",
+                                                 g_get_tmp_dir());
+    temp_fd = mkstemp(temp_file);
+    g_assert(temp_fd >= 0);
+
+    module_call_init(MODULE_INIT_QOM);
+
+    g_test_init(&argc, &argv, NULL);
+    g_test_add_func("/qemu-file/offset/save", test_offset_save);
+    g_test_add_func("/qemu-file/offset/load", test_offset_load);
+#ifndef _WIN32
+    g_test_add_func("/qemu-file/not-seekable", test_not_seekable);
+#endif
+    g_test_run();
+
+    close(temp_fd);
+    unlink(temp_file);
+
+    return 0;
+}
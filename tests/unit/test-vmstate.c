@@ -334,6 +334,81 @@ static void test_simple_array(void)
                          sizeof(wire_simple_arr)));
 }
 
+#define BULK_U32_LEN 600
+
+typedef struct TestBulkArray {
+    uint8_t u8[5];
+    int16_t i16[3];
+    uint32_t u32[BULK_U32_LEN];
+    int64_t i64[2];
+} TestBulkArray;
+
+/* Arrays large enough to take several batches must keep the wire format */
+static const VMStateDescription vmstate_bulk_arr = {
+    .name = "simple/array_bulk",
+    .version_id = 1,
+    .minimum_version_id = 1,
+    .fields = (VMStateField[]) {
+        VMSTATE_UINT8_ARRAY(u8, TestBulkArray, 5),
+        VMSTATE_INT16_ARRAY(i16, TestBulkArray, 3),
+        VMSTATE_UINT32_ARRAY(u32, TestBulkArray, BULK_U32_LEN),
+        VMSTATE_INT64_ARRAY(i64, TestBulkArray, 2),
+        VMSTATE_END_OF_LIST()
+    }
+};
+
+static void obj_bulk_arr_copy(void *target, void *source)
+{
+    memcpy(target, source, sizeof(TestBulkArray));
+}
+
+static void test_bulk_array(void)
+{
+    TestBulkArray obj_src = {
+        .u8 = { 0x01, 0x82, 0x03, 0xf4, 0x05 },
+        .i16 = { 0x0102, -2, 0x7fff },
+        .i64 = { 0x0102030405060708LL, -3 },
+    };
+    TestBulkArray obj, obj_clone;
+    g_autofree uint8_t *wire = NULL;
+    size_t wire_size = 5 + 3 * 2 + BULK_U32_LEN * 4 + 2 * 8 + 1;
+    uint8_t *p;
+    int i;
+
+    for (i = 0; i < BULK_U32_LEN; i++) {
+        obj_src.u32[i] = 0x01000000u * (i & 0xff) + 0x10203 * i;
+    }
+
+    wire = g_malloc(wire_size);
+    p = wire;
+    memcpy(p, obj_src.u8, 5);
+    p += 5;
+    for (i = 0; i < 3; i++) {
+        stw_be_p(p, obj_src.i16[i]);
+        p += 2;
+    }
+    for (i = 0; i < BULK_U32_LEN; i++) {
+        stl_be_p(p, obj_src.u32[i]);
+        p += 4;
+    }
+    for (i = 0; i < 2; i++) {
+        stq_be_p(p, obj_src.i64[i]);
+        p += 8;
+    }
+    *p = QEMU_VM_EOF;
+
+    save_vmstate(&vmstate_bulk_arr, &obj_src);
+    compare_vmstate(wire, wire_size);
+
+    memset(&obj, 0, sizeof(obj));
+    SUCCESS(load_vmstate(&vmstate_bulk_arr, &obj, &obj_clone,
+                         obj_bulk_arr_copy, 1, wire, wire_size));
+    SUCCESS(memcmp(obj.u8, obj_src.u8, sizeof(obj.u8)));
+    SUCCESS(memcmp(obj.i16, obj_src.i16, sizeof(obj.i16)));
+    SUCCESS(memcmp(obj.u32, obj_src.u32, sizeof(obj.u32)));
+    SUCCESS(memcmp(obj.i64, obj_src.i64, sizeof(obj.i64)));
+}
+
 typedef struct TestStruct {
     uint32_t a, b, c, e;
     uint64_t d, f;
@@ -1497,6 +1572,7 @@ int main(int argc, char **argv)
     g_test_init(&argc, &argv, NULL);
     g_test_add_func("/vmstate/simple/primitive", test_simple_primitive);
     g_test_add_func("/vmstate/simple/array", test_simple_array);
+    g_test_add_func("/vmstate/simple/array_bulk", test_bulk_array);
     g_test_add_func("/vmstate/versioned/load/v1", test_load_v1);
     g_test_add_func("/vmstate/versioned/load/v2", test_load_v2);
     g_test_add_func("/vmstate/field_exists/load/noskip", test_load_noskip);
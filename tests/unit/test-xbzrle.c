@@ -174,6 +174,69 @@ static void test_encode_decode(void)
     }
 }
 
+#define XBZRLE_ACCEL_PAGES 64
+
+/*
+ * Every encoder implementation must produce exactly the same stream,
+ * including where it reports overflow.  Dirty the pages with runs of
+ * varying length so that both the byte and the vector paths are hit.
+ */
+static void test_encode_accel(void)
+{
+    uint8_t *old = g_malloc(XBZRLE_ACCEL_PAGES * XBZRLE_PAGE_SIZE);
+    uint8_t *new = g_malloc(XBZRLE_ACCEL_PAGES * XBZRLE_PAGE_SIZE);
+    uint8_t *expected = g_malloc(XBZRLE_ACCEL_PAGES * XBZRLE_PAGE_SIZE);
+    uint8_t *compressed = g_malloc(XBZRLE_PAGE_SIZE);
+    int expected_len[XBZRLE_ACCEL_PAGES];
+    bool first = true;
+    int i, j;
+
+    for (i = 0; i < XBZRLE_ACCEL_PAGES * XBZRLE_PAGE_SIZE; i++) {
+        old[i] = g_test_rand_int_range(0, 4);
+    }
+    memcpy(new, old, XBZRLE_ACCEL_PAGES * XBZRLE_PAGE_SIZE);
+    for (i = 0; i < XBZRLE_ACCEL_PAGES; i++) {
+        uint8_t *page = new + i * XBZRLE_PAGE_SIZE;
+        int max_run = 1 << (i % 8);
+        int runs = g_test_rand_int_range(0, 2 * i + 1);
+
+        for (j = 0; j < runs; j++) {
+            int start = g_test_rand_int_range(0, XBZRLE_PAGE_SIZE);
+            int len = MIN(g_test_rand_int_range(1, max_run + 1),
+                          XBZRLE_PAGE_SIZE - start);
+
+            while (len--) {
+                page[start++] ^= g_test_rand_int_range(1, 256);
+            }
+        }
+    }
+
+    do {
+        for (i = 0; i < XBZRLE_ACCEL_PAGES; i++) {
+            uint8_t *o = old + i * XBZRLE_PAGE_SIZE;
+            uint8_t *n = new + i * XBZRLE_PAGE_SIZE;
+            uint8_t *e = expected + i * XBZRLE_PAGE_SIZE;
+            int dlen;
+
+            dlen = xbzrle_encode_buffer(o, n, XBZRLE_PAGE_SIZE, compressed,
+                                        XBZRLE_PAGE_SIZE);
+            if (first) {
+                expected_len[i] = dlen;
+                memcpy(e, compressed, MAX(dlen, 0));
+            } else {
+                g_assert_cmpint(dlen, ==, expected_len[i]);
+                g_assert(memcmp(e, compressed, MAX(dlen, 0)) == 0);
+            }
+        }
+        first = false;
+    } while (test_xbzrle_encode_next_accel());
+
+    g_free(old);
+    g_free(new);
+    g_free(expected);
+    g_free(compressed);
+}
+
 int main(int argc, char **argv)
 {
     g_test_init(&argc, &argv, NULL);
@@ -186,6 +249,7 @@ int main(int argc, char **argv)
     g_test_add_func("/xbzrle/encode_decode_overflow",
                     test_encode_decode_overflow);
     g_test_add_func("/xbzrle/encode_decode", test_encode_decode);
+    g_test_add_func("/xbzrle/encode_accel", test_encode_accel);
 
     return g_test_run();
 }
@@ -35,6 +35,9 @@
 /* Stop userspace polling on a handler if it isn't active for some time */
 #define POLL_IDLE_INTERVAL_NS (7 * NANOSECONDS_PER_SECOND)
 
+/* Number of aio_poll() wait times between two adaptive polling updates */
+#define POLL_HIST_WINDOW 256
+
 bool aio_poll_disabled(AioContext *ctx)
 {
     return qatomic_read(&ctx->poll_disable_cnt);
@@ -548,6 +551,13 @@ static bool run_poll_handlers(AioContext *ctx, AioHandlerList *ready_list,
         progress = true;
     }
 
+    if (progress) {
+        stat64_add(&ctx->poll_hits, 1);
+    } else {
+        stat64_add(&ctx->poll_misses, 1);
+        stat64_add(&ctx->poll_wasted_ns, elapsed_time);
+    }
+
     /* If time has passed with no successful polling, adjust *timeout to
      * keep the same ending time.
      */
@@ -595,6 +605,50 @@ static bool try_poll_mode(AioContext *ctx, AioHandlerList *ready_list,
     return false;
 }
 
+/*
+ * Record one aio_poll() wait time and, once per POLL_HIST_WINDOW samples,
+ * pick the shortest polling time that would have caught poll_hit_target
+ * percent of them.  If that is longer than poll_max_ns the target cannot be
+ * met within the CPU budget and polling is switched off until the workload
+ * changes.  Old samples decay by halving the histogram after each update.
+ */
+static void adjust_polling_time_adaptive(AioContext *ctx, int64_t block_ns)
+{
+    int bucket = block_ns > 0 ? 63 - clz64(block_ns) : 0;
+    uint64_t total = 0;
+    uint64_t sum = 0;
+    int64_t old = ctx->poll_ns;
+    int i;
+
+    ctx->poll_hist[MIN(bucket, AIO_POLL_HIST_BUCKETS - 1)]++;
+    if (++ctx->poll_hist_samples < POLL_HIST_WINDOW) {
+        return;
+    }
+
+    for (i = 0; i < AIO_POLL_HIST_BUCKETS; i++) {
+        total += ctx->poll_hist[i];
+    }
+    for (i = 0; i < AIO_POLL_HIST_BUCKETS; i++) {
+        sum += ctx->poll_hist[i];
+        if (sum * 100 >= total * ctx->poll_hit_target) {
+            break;
+        }
+    }
+
+    /* Poll up to the end of the bucket that reaches the target */
+    ctx->poll_ns = 2ll << MIN(i, AIO_POLL_HIST_BUCKETS - 1);
+    if (ctx->poll_ns > ctx->poll_max_ns) {
+        ctx->poll_ns = 0;
+    }
+
+    for (i = 0; i < AIO_POLL_HIST_BUCKETS; i++) {
+        ctx->poll_hist[i] /= 2;
+    }
+    ctx->poll_hist_samples = 0;
+
+    trace_poll_adapt(ctx, old, ctx->poll_ns);
+}
+
 bool aio_poll(AioContext *ctx, bool blocking)
 {
     AioHandlerList ready_list = QLIST_HEAD_INITIALIZER(ready_list);
@@ -667,7 +721,9 @@ bool aio_poll(AioContext *ctx, bool blocking)
     if (ctx->poll_max_ns) {
         int64_t block_ns = qemu_clock_get_ns(QEMU_CLOCK_REALTIME) - start;
 
-        if (block_ns <= ctx->poll_ns) {
+        if (ctx->poll_hit_target) {
+            adjust_polling_time_adaptive(ctx, block_ns);
+        } else if (block_ns <= ctx->poll_ns) {
             /* This is the sweet spot, no adjustment needed */
         } else if (block_ns > ctx->poll_max_ns) {
             /* We'd have to poll for too long, poll less */
@@ -749,8 +805,14 @@ void aio_context_use_g_source(AioContext *ctx)
 }
 
 void aio_context_set_poll_params(AioContext *ctx, int64_t max_ns,
-                                 int64_t grow, int64_t shrink, Error **errp)
+                                 int64_t grow, int64_t shrink,
+                                 int64_t hit_target, Error **errp)
 {
+    if (hit_target > 100) {
+        error_setg(errp, "poll-hit-target must be in range [0, 100]");
+        return;
+    }
+
     /* No thread synchronization here, it doesn't matter if an incorrect value
      * is used once.
      */
@@ -758,6 +820,7 @@ void aio_context_set_poll_params(AioContext *ctx, int64_t max_ns,
     ctx->poll_ns = 0;
     ctx->poll_grow = grow;
     ctx->poll_shrink = shrink;
+    ctx->poll_hit_target = hit_target;
 
     aio_notify(ctx);
 }
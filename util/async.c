@@ -559,6 +559,7 @@ AioContext *aio_context_new(Error **errp)
     ctx->poll_max_ns = 0;
     ctx->poll_grow = 0;
     ctx->poll_shrink = 0;
+    ctx->poll_hit_target = 0;
 
     ctx->aio_max_batch = 0;
 
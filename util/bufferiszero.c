@@ -24,6 +24,7 @@
 #include "qemu/osdep.h"
 #include "qemu/cutils.h"
 #include "qemu/bswap.h"
+#include "qemu/bitops.h"
 
 static bool
 buffer_zero_int(const void *buf, size_t len)
@@ -238,6 +239,8 @@ buffer_zero_avx512(const void *buf, size_t len)
 #endif
 
 static unsigned cpuid_cache = INIT_CACHE;
+/* What cpuid_cache was before test_buffer_is_zero_next_accel() */
+static unsigned cpuid_cache_best = INIT_CACHE;
 static bool (*buffer_accel)(const void *, size_t) = INIT_ACCEL;
 static int length_to_accel = 64;
 
@@ -303,7 +306,7 @@ static void __attribute__((constructor)) init_cpuid_cache(void)
             }
         }
     }
-    cpuid_cache = cache;
+    cpuid_cache = cpuid_cache_best = cache;
     init_accel(cache);
 }
 #endif /* CONFIG_AVX2_OPT */
@@ -311,8 +314,11 @@ static void __attribute__((constructor)) init_cpuid_cache(void)
 bool test_buffer_is_zero_next_accel(void)
 {
     /* If no bits set, we just tested buffer_zero_int, and there
-       are no more acceleration options to test.  */
+       are no more acceleration options to test.  Start over from
+       the best one for the next caller.  */
     if (cpuid_cache == 0) {
+        cpuid_cache = cpuid_cache_best;
+        init_accel(cpuid_cache);
         return false;
     }
     /* Disable the accelerator we used before and select a new one.  */
@@ -321,6 +327,27 @@ bool test_buffer_is_zero_next_accel(void)
     return true;
 }
 
+const char *test_buffer_is_zero_accel_name(void)
+{
+#ifdef CONFIG_AVX512F_OPT
+    if (buffer_accel == buffer_zero_avx512) {
+        return "avx512";
+    }
+#endif
+#ifdef CONFIG_AVX2_OPT
+    if (buffer_accel == buffer_zero_avx2) {
+        return "avx2";
+    }
+    if (buffer_accel == buffer_zero_sse4) {
+        return "sse4";
+    }
+#endif
+    if (buffer_accel == buffer_zero_sse2) {
+        return "sse2";
+    }
+    return "int";
+}
+
 static bool select_accel_fn(const void *buf, size_t len)
 {
     if (likely(len >= length_to_accel)) {
@@ -329,12 +356,77 @@ static bool select_accel_fn(const void *buf, size_t len)
     return buffer_zero_int(buf, len);
 }
 
+#elif defined(__aarch64__)
+#include <arm_neon.h>
+
+/* Note that this vectorized function requires len >= 64.  */
+
+static bool
+buffer_zero_neon(const void *buf, size_t len)
+{
+    uint32x4_t t = vreinterpretq_u32_u8(vld1q_u8(buf));
+    const uint32x4_t *p = (uint32x4_t *)(((uintptr_t)buf + 5 * 16) & -16);
+    const uint32x4_t *e = (uint32x4_t *)(((uintptr_t)buf + len) & -16);
+
+    /* Loop over 16-byte aligned blocks of 64.  */
+    while (likely(p <= e)) {
+        __builtin_prefetch(p);
+        if (unlikely(vmaxvq_u32(t) != 0)) {
+            return false;
+        }
+        t = vorrq_u32(vorrq_u32(p[-4], p[-3]), vorrq_u32(p[-2], p[-1]));
+        p += 4;
+    }
+
+    /* Finish the aligned tail.  */
+    t = vorrq_u32(t, e[-3]);
+    t = vorrq_u32(t, e[-2]);
+    t = vorrq_u32(t, e[-1]);
+
+    /* Finish the unaligned tail.  */
+    t = vorrq_u32(t, vreinterpretq_u32_u8(vld1q_u8(buf + len - 16)));
+
+    return vmaxvq_u32(t) == 0;
+}
+
+/* Advanced SIMD is mandatory on AArch64, so there is nothing to probe.  */
+static bool use_neon = true;
+
+bool test_buffer_is_zero_next_accel(void)
+{
+    if (!use_neon) {
+        /* All tried; start over from NEON for the next caller.  */
+        use_neon = true;
+        return false;
+    }
+    use_neon = false;
+    return true;
+}
+
+const char *test_buffer_is_zero_accel_name(void)
+{
+    return use_neon ? "neon" : "int";
+}
+
+static bool select_accel_fn(const void *buf, size_t len)
+{
+    if (likely(use_neon && len >= 64)) {
+        return buffer_zero_neon(buf, len);
+    }
+    return buffer_zero_int(buf, len);
+}
+
 #else
 #define select_accel_fn  buffer_zero_int
 bool test_buffer_is_zero_next_accel(void)
 {
     return false;
 }
+
+const char *test_buffer_is_zero_accel_name(void)
+{
+    return "int";
+}
 #endif
 
 /*
@@ -353,3 +445,37 @@ bool buffer_is_zero(const void *buf, size_t len)
        includes a check for an unrolled loop over 64-bit integers.  */
     return select_accel_fn(buf, len);
 }
+
+/*
+ * Checks each @page_size chunk of a buffer for zeroes, setting the
+ * corresponding bit in @bitmap for the chunks that are all zero.
+ * Returns the number of zero chunks.
+ */
+size_t buffer_zero_pages(const void *buf, size_t len, size_t page_size,
+                         unsigned long *bitmap)
+{
+    size_t nr_pages = DIV_ROUND_UP(len, page_size);
+    size_t zero_pages = 0;
+    size_t i;
+
+    assert(page_size);
+
+    for (i = 0; i < nr_pages; i++) {
+        size_t offset = i * page_size;
+        size_t size = MIN(page_size, len - offset);
+
+        /* Fetch the next page while this one is being checked.  */
+        if (i + 1 < nr_pages) {
+            __builtin_prefetch(buf + offset + page_size);
+        }
+
+        if (select_accel_fn(buf + offset, size)) {
+            set_bit(i, bitmap);
+            zero_pages++;
+        } else {
+            clear_bit(i, bitmap);
+        }
+    }
+
+    return zero_pages;
+}
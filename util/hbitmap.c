@@ -217,6 +217,32 @@ int64_t hbitmap_next_dirty(const HBitmap *hb, int64_t start, int64_t count)
     return MAX(start, first_dirty_off);
 }
 
+/* Return the index of the first word in [pos, end) that is not all ones,
+ * or @end if there is none.
+ */
+static size_t hb_skip_full_words(const unsigned long *words,
+                                 size_t pos, size_t end)
+{
+    /* Test eight words per iteration: this keeps the number of branches
+     * low on long dirty runs, and the compiler can vectorize the AND.
+     */
+    while (pos + 8 <= end) {
+        unsigned long t = words[pos] & words[pos + 1] &
+                          words[pos + 2] & words[pos + 3] &
+                          words[pos + 4] & words[pos + 5] &
+                          words[pos + 6] & words[pos + 7];
+
+        if (t != (unsigned long)-1) {
+            break;
+        }
+        pos += 8;
+    }
+    while (pos < end && words[pos] == (unsigned long)-1) {
+        pos++;
+    }
+    return pos;
+}
+
 int64_t hbitmap_next_zero(const HBitmap *hb, int64_t start, int64_t count)
 {
     size_t pos = (start >> hb->granularity) >> BITS_PER_LEVEL;
@@ -245,10 +271,7 @@ int64_t hbitmap_next_zero(const HBitmap *hb, int64_t start, int64_t count)
     assert((start >> hb->granularity) < hb->size);
 
     if (cur == (unsigned long)-1) {
-        do {
-            pos++;
-        } while (pos < sz && last_lev[pos] == (unsigned long)-1);
-
+        pos = hb_skip_full_words(last_lev, pos + 1, sz);
         if (pos >= sz) {
             return -1;
         }
@@ -649,6 +672,7 @@ void hbitmap_serialize_part(const HBitmap *hb, uint8_t *buf,
     serialization_chunk(hb, start, count, &cur, &el_count);
     end = cur + el_count;
 
+#ifdef HOST_WORDS_BIGENDIAN
     while (cur != end) {
         unsigned long el =
             (BITS_PER_LONG == 32 ? cpu_to_le32(*cur) : cpu_to_le64(*cur));
@@ -657,6 +681,10 @@ void hbitmap_serialize_part(const HBitmap *hb, uint8_t *buf,
         buf += sizeof(el);
         cur++;
     }
+#else
+    /* The serialized format is the in-memory layout of a little endian host */
+    memcpy(buf, cur, (end - cur) * sizeof(*cur));
+#endif
 }
 
 void hbitmap_deserialize_part(HBitmap *hb, uint8_t *buf,
@@ -672,6 +700,7 @@ void hbitmap_deserialize_part(HBitmap *hb, uint8_t *buf,
     serialization_chunk(hb, start, count, &cur, &el_count);
     end = cur + el_count;
 
+#ifdef HOST_WORDS_BIGENDIAN
     while (cur != end) {
         memcpy(cur, buf, sizeof(*cur));
 
@@ -684,6 +713,9 @@ void hbitmap_deserialize_part(HBitmap *hb, uint8_t *buf,
         buf += sizeof(unsigned long);
         cur++;
     }
+#else
+    memcpy(cur, buf, (end - cur) * sizeof(*cur));
+#endif
     if (finish) {
         hbitmap_deserialize_finish(hb);
     }
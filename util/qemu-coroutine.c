@@ -18,6 +18,8 @@
 #include "qemu/atomic.h"
 #include "qemu/coroutine.h"
 #include "qemu/coroutine_int.h"
+#include "qemu/main-loop.h"
+#include "qemu/timer.h"
 #include "block/aio.h"
 
 /** Initial batch size is 64, and is increased on demand */
@@ -25,10 +27,18 @@ enum {
     POOL_INITIAL_BATCH_SIZE = 64,
 };
 
+/*
+ * If no thread took coroutines from release_pool during this interval,
+ * half of the pool is freed.
+ */
+#define POOL_DECAY_INTERVAL_MS 10000
+
 /** Free list to speed up creation */
 static QSLIST_HEAD(, Coroutine) release_pool = QSLIST_HEAD_INITIALIZER(pool);
 static unsigned int pool_batch_size = POOL_INITIAL_BATCH_SIZE;
 static unsigned int release_pool_size;
+static bool release_pool_used;
+static QEMUTimer *pool_decay_timer;
 static __thread QSLIST_HEAD(, Coroutine) alloc_pool = QSLIST_HEAD_INITIALIZER(pool);
 static __thread unsigned int alloc_pool_size;
 static __thread Notifier coroutine_pool_cleanup_notifier;
@@ -64,6 +74,7 @@ Coroutine *qemu_coroutine_create(CoroutineEntry *entry, void *opaque)
                  */
                 alloc_pool_size = qatomic_xchg(&release_pool_size, 0);
                 QSLIST_MOVE_ATOMIC(&alloc_pool, &release_pool);
+                qatomic_set(&release_pool_used, true);
                 co = QSLIST_FIRST(&alloc_pool);
             }
         }
@@ -83,6 +94,8 @@ Coroutine *qemu_coroutine_create(CoroutineEntry *entry, void *opaque)
     return co;
 }
 
+static void coroutine_pool_arm_decay(void);
+
 static void coroutine_delete(Coroutine *co)
 {
     co->caller = NULL;
@@ -90,7 +103,9 @@ static void coroutine_delete(Coroutine *co)
     if (CONFIG_COROUTINE_POOL) {
         if (release_pool_size < qatomic_read(&pool_batch_size) * 2) {
             QSLIST_INSERT_HEAD_ATOMIC(&release_pool, co, pool_next);
-            qatomic_inc(&release_pool_size);
+            if (qatomic_fetch_inc(&release_pool_size) == 0) {
+                coroutine_pool_arm_decay();
+            }
             return;
         }
         if (alloc_pool_size < qatomic_read(&pool_batch_size)) {
@@ -210,7 +225,92 @@ void qemu_coroutine_increase_pool_batch_size(unsigned int additional_pool_size)
     qatomic_add(&pool_batch_size, additional_pool_size);
 }
 
+/*
+ * Free the coroutines in release_pool beyond the first @max_size.  The
+ * memory they hold, mostly their stacks, is otherwise only given back
+ * when the process exits.
+ */
+static void coroutine_pool_trim(unsigned int max_size)
+{
+    QSLIST_HEAD(, Coroutine) pool = QSLIST_HEAD_INITIALIZER(pool);
+    unsigned int kept = 0;
+    unsigned int freed = 0;
+    Coroutine *co;
+    Coroutine *tmp;
+
+    /* Same skew as in qemu_coroutine_create(), the size is a heuristic */
+    qatomic_xchg(&release_pool_size, 0);
+    QSLIST_MOVE_ATOMIC(&pool, &release_pool);
+
+    QSLIST_FOREACH_SAFE(co, &pool, pool_next, tmp) {
+        QSLIST_REMOVE_HEAD(&pool, pool_next);
+        if (kept < max_size) {
+            QSLIST_INSERT_HEAD_ATOMIC(&release_pool, co, pool_next);
+            kept++;
+        } else {
+            qemu_coroutine_delete(co);
+            freed++;
+        }
+    }
+
+    qatomic_add(&release_pool_size, kept);
+    trace_qemu_coroutine_pool_trim(kept, freed);
+}
+
+/*
+ * The pool is sized for the peak number of coroutines, which may only be
+ * reached once, e.g. during a burst of I/O at boot.  Give back what an
+ * idle pool holds, halving it at every interval without demand.
+ * Runs in the main loop.
+ */
+static void coroutine_pool_decay(void *opaque)
+{
+    if (!qatomic_xchg(&release_pool_used, false)) {
+        coroutine_pool_trim(qatomic_read(&release_pool_size) / 2);
+    }
+
+    if (qatomic_read(&release_pool_size)) {
+        timer_mod(pool_decay_timer,
+                  qemu_clock_get_ms(QEMU_CLOCK_REALTIME) +
+                  POOL_DECAY_INTERVAL_MS);
+    }
+}
+
+/* Called when release_pool becomes non-empty, from any thread */
+static void coroutine_pool_arm_decay(void)
+{
+    AioContext *ctx = qemu_get_aio_context();
+    QEMUTimer *timer = qatomic_read(&pool_decay_timer);
+
+    if (!timer) {
+        /* No main loop, e.g. in unit tests: the pool only shrinks on demand */
+        if (!ctx) {
+            return;
+        }
+        timer = aio_timer_new(ctx, QEMU_CLOCK_REALTIME, SCALE_MS,
+                              coroutine_pool_decay, NULL);
+        if (qatomic_cmpxchg(&pool_decay_timer, NULL, timer)) {
+            timer_free(timer);
+            timer = qatomic_read(&pool_decay_timer);
+        }
+    }
+
+    if (!timer_pending(timer)) {
+        timer_mod(timer, qemu_clock_get_ms(QEMU_CLOCK_REALTIME) +
+                         POOL_DECAY_INTERVAL_MS);
+    }
+}
+
+unsigned int qemu_coroutine_get_pool_size(void)
+{
+    return qatomic_read(&release_pool_size);
+}
+
 void qemu_coroutine_decrease_pool_batch_size(unsigned int removing_pool_size)
 {
     qatomic_sub(&pool_batch_size, removing_pool_size);
+
+    if (CONFIG_COROUTINE_POOL) {
+        coroutine_pool_trim(qatomic_read(&pool_batch_size) * 2);
+    }
 }
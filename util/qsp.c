@@ -24,6 +24,14 @@
  * synchronization objects this might be expensive, but note that it is
  * very rarely called -- reports are generated only when requested by users.
  *
+ * Recording every acquisition is too expensive to leave enabled on a busy
+ * system, so QSP can also run in a sampling mode: only every Nth operation
+ * of each thread is profiled and, optionally, only lock acquisitions that
+ * actually block. Contention is detected with a trylock before taking the
+ * lock, so uncontended acquisitions do not even read the clock. Each call
+ * site keeps a histogram of its wait times, which is more telling than the
+ * average when a few long waits dominate.
+ *
  * Reports are generated as a table where each row represents a call site. A
  * call site is the triplet formed by the __file__ and __LINE__ of the caller
  * as well as the address of the "object" (i.e. mutex, rec. mutex or condvar)
@@ -85,6 +93,7 @@ struct QSPEntry {
     const QSPCallSite *callsite;
     aligned_uint64_t n_acqs;
     aligned_uint64_t ns;
+    aligned_uint64_t hist[QSP_HIST_BUCKETS];
     unsigned int n_objs; /* count of coalesced objs; only used for reporting */
 };
 typedef struct QSPEntry QSPEntry;
@@ -107,6 +116,11 @@ static size_t qsp_qemu_path_len;
 /* the address of qsp_thread gives us a unique 'thread ID' */
 static __thread int qsp_thread;
 
+/* sampling parameters; see qsp_set_sampling() */
+static unsigned int qsp_sample_period = 1;
+static bool qsp_contended_only;
+static __thread unsigned int qsp_sample_count;
+
 /*
  * Call sites are the same for all threads, so we track them in a separate hash
  * table to save memory.
@@ -340,13 +354,27 @@ static QSPEntry *qsp_entry_get(const void *obj, const char *file, int line,
     return qsp_entry_find(&qsp_ht, &orig, hash);
 }
 
+/* bucket 0 is for waits below 1 us, bucket i for [2^(i-1), 2^i) us */
+static inline int qsp_hist_bucket(int64_t ns)
+{
+    uint64_t us = ns / 1000;
+
+    if (us == 0) {
+        return 0;
+    }
+    return MIN(64 - clz64(us), QSP_HIST_BUCKETS - 1);
+}
+
 /*
  * @e is in the global hash table; it is only written to by the current thread,
  * so we write to it atomically (as in "write once") to prevent torn reads.
  */
 static inline void do_qsp_entry_record(QSPEntry *e, int64_t delta, bool acq)
 {
+    int b = qsp_hist_bucket(delta);
+
     qatomic_set_u64(&e->ns, e->ns + delta);
+    qatomic_set_u64(&e->hist[b], e->hist[b] + 1);
     if (acq) {
         qatomic_set_u64(&e->n_acqs, e->n_acqs + 1);
     }
@@ -357,12 +385,40 @@ static inline void qsp_entry_record(QSPEntry *e, int64_t delta)
     do_qsp_entry_record(e, delta, true);
 }
 
-#define QSP_GEN_VOID(type_, qsp_t_, func_, impl_)                       \
+/* Returns true if the current operation of this thread is to be profiled */
+static inline bool qsp_sample(void)
+{
+    unsigned int period = qatomic_read(&qsp_sample_period);
+
+    if (likely(period <= 1)) {
+        return true;
+    }
+    if (++qsp_sample_count < period) {
+        return false;
+    }
+    qsp_sample_count = 0;
+    return true;
+}
+
+/*
+ * In contended-only mode, an uncontended lock is taken by the trylock and
+ * not recorded at all.
+ */
+#define QSP_GEN_VOID(type_, qsp_t_, func_, impl_, trylock_impl_)        \
     static void func_(type_ *obj, const char *file, int line)           \
     {                                                                   \
         QSPEntry *e;                                                    \
         int64_t t0, t1;                                                 \
                                                                         \
+        if (!qsp_sample()) {                                            \
+            impl_(obj, file, line);                                     \
+            return;                                                     \
+        }                                                               \
+        if (qatomic_read(&qsp_contended_only) &&                        \
+            trylock_impl_(obj, file, line) == 0) {                      \
+            return;                                                     \
+        }                                                               \
+                                                                        \
         t0 = get_clock();                                               \
         impl_(obj, file, line);                                         \
         t1 = get_clock();                                               \
@@ -371,6 +427,7 @@ static inline void qsp_entry_record(QSPEntry *e, int64_t delta)
         qsp_entry_record(e, t1 - t0);                                   \
     }
 
+/* In contended-only mode, only failed trylocks are recorded */
 #define QSP_GEN_RET1(type_, qsp_t_, func_, impl_)                       \
     static int func_(type_ *obj, const char *file, int line)            \
     {                                                                   \
@@ -378,21 +435,30 @@ static inline void qsp_entry_record(QSPEntry *e, int64_t delta)
         int64_t t0, t1;                                                 \
         int err;                                                        \
                                                                         \
+        if (!qsp_sample()) {                                            \
+            return impl_(obj, file, line);                              \
+        }                                                               \
+                                                                        \
         t0 = get_clock();                                               \
         err = impl_(obj, file, line);                                   \
         t1 = get_clock();                                               \
                                                                         \
+        if (!err && qatomic_read(&qsp_contended_only)) {                \
+            return err;                                                 \
+        }                                                               \
         e = qsp_entry_get(obj, file, line, qsp_t_);                     \
         do_qsp_entry_record(e, t1 - t0, !err);                          \
         return err;                                                     \
     }
 
-QSP_GEN_VOID(QemuMutex, QSP_BQL_MUTEX, qsp_bql_mutex_lock, qemu_mutex_lock_impl)
-QSP_GEN_VOID(QemuMutex, QSP_MUTEX, qsp_mutex_lock, qemu_mutex_lock_impl)
+QSP_GEN_VOID(QemuMutex, QSP_BQL_MUTEX, qsp_bql_mutex_lock,
+             qemu_mutex_lock_impl, qemu_mutex_trylock_impl)
+QSP_GEN_VOID(QemuMutex, QSP_MUTEX, qsp_mutex_lock, qemu_mutex_lock_impl,
+             qemu_mutex_trylock_impl)
 QSP_GEN_RET1(QemuMutex, QSP_MUTEX, qsp_mutex_trylock, qemu_mutex_trylock_impl)
 
 QSP_GEN_VOID(QemuRecMutex, QSP_REC_MUTEX, qsp_rec_mutex_lock,
-             qemu_rec_mutex_lock_impl)
+             qemu_rec_mutex_lock_impl, qemu_rec_mutex_trylock_impl)
 QSP_GEN_RET1(QemuRecMutex, QSP_REC_MUTEX, qsp_rec_mutex_trylock,
              qemu_rec_mutex_trylock_impl)
 
@@ -405,6 +471,11 @@ qsp_cond_wait(QemuCond *cond, QemuMutex *mutex, const char *file, int line)
     QSPEntry *e;
     int64_t t0, t1;
 
+    if (!qsp_sample()) {
+        qemu_cond_wait_impl(cond, mutex, file, line);
+        return;
+    }
+
     t0 = get_clock();
     qemu_cond_wait_impl(cond, mutex, file, line);
     t1 = get_clock();
@@ -421,6 +492,10 @@ qsp_cond_timedwait(QemuCond *cond, QemuMutex *mutex, int ms,
     int64_t t0, t1;
     bool ret;
 
+    if (!qsp_sample()) {
+        return qemu_cond_timedwait_impl(cond, mutex, ms, file, line);
+    }
+
     t0 = get_clock();
     ret = qemu_cond_timedwait_impl(cond, mutex, ms, file, line);
     t1 = get_clock();
@@ -446,6 +521,18 @@ void qsp_enable(void)
     qatomic_set(&qemu_cond_timedwait_func, qsp_cond_timedwait);
 }
 
+void qsp_set_sampling(unsigned int period, bool contended_only)
+{
+    qatomic_set(&qsp_sample_period, MAX(period, 1));
+    qatomic_set(&qsp_contended_only, contended_only);
+}
+
+void qsp_get_sampling(unsigned int *period, bool *contended_only)
+{
+    *period = qatomic_read(&qsp_sample_period);
+    *contended_only = qatomic_read(&qsp_contended_only);
+}
+
 void qsp_disable(void)
 {
     qatomic_set(&qemu_mutex_lock_func, qemu_mutex_lock_impl);
@@ -531,6 +618,7 @@ static void qsp_aggregate(void *p, uint32_t h, void *up)
     const QSPEntry *e = p;
     QSPEntry *agg;
     uint32_t hash;
+    int i;
 
     hash = qsp_entry_no_thread_hash(e);
     agg = qsp_entry_find(ht, e, hash);
@@ -540,6 +628,9 @@ static void qsp_aggregate(void *p, uint32_t h, void *up)
      */
     agg->ns += qatomic_read_u64(&e->ns);
     agg->n_acqs += qatomic_read_u64(&e->n_acqs);
+    for (i = 0; i < QSP_HIST_BUCKETS; i++) {
+        agg->hist[i] += qatomic_read_u64(&e->hist[i]);
+    }
 }
 
 static void qsp_iter_diff(void *p, uint32_t hash, void *htp)
@@ -547,6 +638,7 @@ static void qsp_iter_diff(void *p, uint32_t hash, void *htp)
     struct qht *ht = htp;
     QSPEntry *old = p;
     QSPEntry *new;
+    int i;
 
     new = qht_lookup(ht, old, hash);
     /* entries are never deleted, so we must have this one */
@@ -557,6 +649,10 @@ static void qsp_iter_diff(void *p, uint32_t hash, void *htp)
 
     new->n_acqs -= old->n_acqs;
     new->ns -= old->ns;
+    for (i = 0; i < QSP_HIST_BUCKETS; i++) {
+        g_assert(new->hist[i] >= old->hist[i]);
+        new->hist[i] -= old->hist[i];
+    }
 
     /* No point in reporting an empty entry */
     if (new->n_acqs == 0 && new->ns == 0) {
@@ -578,6 +674,7 @@ static void qsp_iter_callsite_coalesce(void *p, uint32_t h, void *htp)
     QSPEntry *old = p;
     QSPEntry *e;
     uint32_t hash;
+    int i;
 
     hash = qsp_entry_no_thread_obj_hash(old);
     e = qht_lookup(ht, old, hash);
@@ -589,6 +686,9 @@ static void qsp_iter_callsite_coalesce(void *p, uint32_t h, void *htp)
     }
     e->ns += old->ns;
     e->n_acqs += old->n_acqs;
+    for (i = 0; i < QSP_HIST_BUCKETS; i++) {
+        e->hist[i] += old->hist[i];
+    }
 }
 
 static void qsp_ht_delete(void *p, uint32_t h, void *htp)
@@ -658,17 +758,6 @@ static char *qsp_at(const QSPCallSite *callsite)
     return g_string_free(s, FALSE);
 }
 
-struct QSPReportEntry {
-    const void *obj;
-    char *callsite_at;
-    const char *typename;
-    double time_s;
-    double ns_avg;
-    uint64_t n_acqs;
-    unsigned int n_objs;
-};
-typedef struct QSPReportEntry QSPReportEntry;
-
 struct QSPReport {
     QSPReportEntry *entries;
     size_t n_entries;
@@ -695,6 +784,7 @@ static gboolean qsp_tree_report(gpointer key, gpointer value, gpointer udata)
     entry->time_s = e->ns * 1e-9;
     entry->n_acqs = e->n_acqs;
     entry->ns_avg = e->n_acqs ? e->ns / e->n_acqs : 0;
+    memcpy(entry->hist, e->hist, sizeof(entry->hist));
     return FALSE;
 }
 
@@ -765,26 +855,46 @@ static void report_destroy(QSPReport *rep)
     g_free(rep->entries);
 }
 
-void qsp_report(size_t max, enum QSPSortBy sort_by,
-                bool callsite_coalesce)
+static void report_init(QSPReport *rep, size_t max, enum QSPSortBy sort_by,
+                        bool callsite_coalesce)
 {
     GTree *tree = g_tree_new_full(qsp_tree_cmp, &sort_by, g_free, NULL);
-    QSPReport rep;
 
     qsp_init();
 
-    rep.entries = g_new0(QSPReportEntry, max);
-    rep.n_entries = 0;
-    rep.max_n_entries = max;
+    rep->entries = g_new0(QSPReportEntry, max);
+    rep->n_entries = 0;
+    rep->max_n_entries = max;
 
     qsp_mktree(tree, callsite_coalesce);
-    g_tree_foreach(tree, qsp_tree_report, &rep);
+    g_tree_foreach(tree, qsp_tree_report, rep);
     g_tree_destroy(tree);
+}
 
+void qsp_report(size_t max, enum QSPSortBy sort_by,
+                bool callsite_coalesce)
+{
+    QSPReport rep;
+
+    report_init(&rep, max, sort_by, callsite_coalesce);
     pr_report(&rep);
     report_destroy(&rep);
 }
 
+void qsp_report_iter(size_t max, enum QSPSortBy sort_by,
+                     bool callsite_coalesce, QSPReportIterFunc *func,
+                     void *opaque)
+{
+    QSPReport rep;
+    size_t i;
+
+    report_init(&rep, max, sort_by, callsite_coalesce);
+    for (i = 0; i < rep.n_entries; i++) {
+        func(&rep.entries[i], opaque);
+    }
+    report_destroy(&rep);
+}
+
 static void qsp_snapshot_destroy(QSPSnapshot *snap)
 {
     qht_iter(&snap->ht, qsp_ht_delete, NULL);